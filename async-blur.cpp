@@ -0,0 +1,220 @@
+#include <iostream>
+#include <memory>
+
+#include "async-blur.h"
+
+static constexpr unsigned PixelSize = 16;
+
+AsyncBlur::AsyncBlur(cl::Context const& context, int maxInFlight) :
+    context_ (context),
+    queue_ (),
+    rotational_ (context),
+    convolution_ (context),
+    maxInFlight_ (maxInFlight),
+    enqueueMutex_ (),
+    slotsMutex_ (),
+    slotFree_ (),
+    finished_ (),
+    inFlight_ (0),
+    callbacks_ (0),
+    finishedRequests_ (),
+    stop_ (false),
+    callbackThread_ ()
+{
+    if (maxInFlight < 1)
+        throw cl::Error(CL_INVALID_VALUE, "AsyncBlur");
+
+    queue_ = rotational_.queue();
+    callbackThread_ = std::thread([this]
+    {
+        runCallbacks();
+    });
+}
+
+AsyncBlur::~AsyncBlur()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(slotsMutex_);
+        stop_ = true;
+        finished_.notify_all();
+    }
+    callbackThread_.join();
+}
+
+void AsyncBlur::wait()
+{
+    std::unique_lock<std::mutex> lock(slotsMutex_);
+    slotFree_.wait(lock, [this]
+    {
+        return inFlight_ == 0 && callbacks_ == 0;
+    });
+}
+
+int AsyncBlur::inFlight()
+{
+    std::lock_guard<std::mutex> lock(slotsMutex_);
+    return inFlight_;
+}
+
+void AsyncBlur::acquire()
+{
+    std::unique_lock<std::mutex> lock(slotsMutex_);
+    slotFree_.wait(lock, [this]
+    {
+        return inFlight_ < maxInFlight_;
+    });
+    inFlight_++;
+}
+
+void AsyncBlur::finish(Request* request, int status)
+{
+    // The slot is freed here rather than by the callback thread, so that a
+    // callback blocked submitting a follow-up request waits on runtime
+    // completions only, never on itself. Notified under the lock: wait()
+    // in the destructor cannot return, and destroy the mutex, before this
+    // is done with it.
+    std::lock_guard<std::mutex> lock(slotsMutex_);
+    inFlight_--;
+    callbacks_++;
+    finishedRequests_.emplace_back(request, status);
+    slotFree_.notify_all();
+    finished_.notify_one();
+}
+
+void AsyncBlur::runCallbacks()
+{
+    std::unique_lock<std::mutex> lock(slotsMutex_);
+    for (;;)
+    {
+        finished_.wait(lock, [this]
+        {
+            return stop_ || !finishedRequests_.empty();
+        });
+        if (finishedRequests_.empty())
+            return;
+
+        auto finished = finishedRequests_.front();
+        finishedRequests_.pop_front();
+        lock.unlock();
+
+        if (finished.first->done)
+            finished.first->done(finished.second);
+        delete finished.first;
+
+        lock.lock();
+        callbacks_--;
+        slotFree_.notify_all();
+    }
+}
+
+void CL_CALLBACK AsyncBlur::complete(cl_event, cl_int status, void* data)
+{
+    auto request = static_cast<Request*>(data);
+
+    // A negative status is the error that terminated the command
+    request->owner->finish(request, status < 0 ? status : CL_SUCCESS);
+}
+
+void AsyncBlur::submit(Request* request, std::function<cl::Event(Request& request)> const& enqueue)
+{
+    acquire();
+
+    cl::Event read;
+    bool enqueued = false;
+    try
+    {
+        {
+            std::lock_guard<std::mutex> lock(enqueueMutex_);
+            read = enqueue(*request);
+            enqueued = true;
+            // Nothing else may ever wait on the queue, the commands have
+            // to reach the device for the callback to come
+            queue_.flush();
+        }
+        read.setCallback(CL_COMPLETE, complete, request);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        // The read into the caller's image is queued, it must be done
+        // before the caller learns of the failure and frees the image
+        if (enqueued)
+        {
+            try
+            {
+                read.wait();
+            }
+            catch (cl::Error const&)
+            {
+            }
+        }
+        finish(request, err.err());
+    }
+}
+
+void AsyncBlur::rotationalBlur(float* image, int width, int height, float angle, RotationalQuality quality,
+                               BlurCallback done)
+{
+    size_t dataSize = size_t(width) * height * PixelSize;
+
+    submit(new Request {this, done, {}}, [&](Request& request)
+    {
+        cl::Buffer devInputImage(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, image);
+        cl::Buffer devOutputImage(context_, CL_MEM_WRITE_ONLY, dataSize);
+        request.buffers = {devInputImage, devOutputImage};
+
+        cl::Event read;
+        rotational_.enqueue(queue_, devInputImage, devOutputImage, width, height, angle, rotational_sampling(quality));
+        queue_.enqueueReadBuffer(devOutputImage, CL_FALSE, 0, dataSize, image, nullptr, &read);
+        return read;
+    });
+}
+
+std::future<int> AsyncBlur::rotationalBlur(float* image, int width, int height, float angle,
+                                           RotationalQuality quality)
+{
+    auto promise = std::make_shared<std::promise<int>>();
+    auto result = promise->get_future();
+
+    rotationalBlur(image, width, height, angle, quality, [promise](int status)
+    {
+        promise->set_value(status);
+    });
+    return result;
+}
+
+void AsyncBlur::convolution(float const* in, float* out, int width, int height, std::vector<float> const& filter,
+                            int filterWidth, BlurCallback done)
+{
+    size_t dataSize = size_t(width) * height * sizeof(float);
+
+    submit(new Request {this, done, {}}, [&](Request& request)
+    {
+        cl::Buffer devInputImage(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                                 const_cast<float*>(in));
+        cl::Buffer devOutputImage(context_, CL_MEM_WRITE_ONLY, dataSize);
+        cl::Buffer devFilter(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filter.size() * sizeof(float),
+                             const_cast<float*>(filter.data()));
+        request.buffers = {devInputImage, devOutputImage, devFilter};
+
+        cl::Event read;
+        convolution_.enqueue(queue_, devInputImage, devOutputImage, devFilter, width, height, filterWidth);
+        queue_.enqueueReadBuffer(devOutputImage, CL_FALSE, 0, dataSize, out, nullptr, &read);
+        return read;
+    });
+}
+
+std::future<int> AsyncBlur::convolution(float const* in, float* out, int width, int height,
+                                        std::vector<float> const& filter, int filterWidth)
+{
+    auto promise = std::make_shared<std::promise<int>>();
+    auto result = promise->get_future();
+
+    convolution(in, out, width, height, filter, filterWidth, [promise](int status)
+    {
+        promise->set_value(status);
+    });
+    return result;
+}
@@ -0,0 +1,105 @@
+#ifndef ASYNC_BLUR_H
+#define ASYNC_BLUR_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "opencl.h"
+#include "convolution.h"
+#include "rotational-blur.h"
+
+// Completion of a request with CL_SUCCESS or the OpenCL error code. Runs
+// on the engine's callback thread, one at a time in completion order, so
+// a slow callback delays the others but never the device. It may submit
+// follow-up requests but must not call wait() or destroy the engine.
+typedef std::function<void(int status)> BlurCallback;
+
+// rotational_blur() and blur_image()'s convolution without blocking the
+// calling thread. A request copies its input when it is submitted,
+// enqueues the kernels and a non-blocking read of the result on the
+// engine's in-order queue. The event callback (clSetEventCallback) of
+// that read runs on a thread of the OpenCL runtime, where blocking OpenCL
+// calls are not allowed, so it only frees the request's slot and hands
+// the request to the callback thread. Output images must stay valid until
+// the callback.
+//
+// At most `maxInFlight` requests are on the queue at a time; submitting
+// another blocks the caller until one completes, which bounds the device
+// memory and the latency of a queue that only grows. Submitting from
+// several threads is safe.
+struct AsyncBlur
+{
+    AsyncBlur(cl::Context const& context, int maxInFlight = 16);
+
+    // Waits for all requests and their callbacks
+    ~AsyncBlur();
+
+    // Blurs `image`, interleaved float4, in place
+    void rotationalBlur(float* image, int width, int height, float angle, RotationalQuality quality,
+                        BlurCallback done);
+    std::future<int> rotationalBlur(float* image, int width, int height, float angle,
+                                    RotationalQuality quality = QUALITY_FINAL);
+
+    // Single channel, every pixel, taps clamped to the image
+    void convolution(float const* in, float* out, int width, int height, std::vector<float> const& filter,
+                     int filterWidth, BlurCallback done);
+    std::future<int> convolution(float const* in, float* out, int width, int height,
+                                 std::vector<float> const& filter, int filterWidth);
+
+    // Blocks until no request is in flight and no callback runs
+    void wait();
+
+    int inFlight();
+
+    cl::CommandQueue queue() const
+    {
+        return queue_;
+    }
+
+private:
+    // Device buffers of a request, released when it completes
+    struct Request
+    {
+        AsyncBlur* owner;
+        BlurCallback done;
+        std::vector<cl::Buffer> buffers;
+    };
+
+    static void CL_CALLBACK complete(cl_event event, cl_int status, void* data);
+
+    // Takes a slot of maxInFlight_, blocking until one is free
+    void acquire();
+    // Frees the slot of `request` and queues it for the callback thread,
+    // never blocks
+    void finish(Request* request, int status);
+    // The callback thread: calls and deletes finished requests
+    void runCallbacks();
+
+    // Runs `enqueue` under enqueueMutex_ and arranges for `request` to
+    // complete with the event it returns. Failures complete it at once,
+    // once a read that was already queued is done.
+    void submit(Request* request, std::function<cl::Event(Request& request)> const& enqueue);
+
+    cl::Context context_;
+    cl::CommandQueue queue_;
+    RotationalBlur rotational_;
+    Convolution convolution_;
+    int maxInFlight_;
+    std::mutex enqueueMutex_;   // the engines set kernel arguments
+    std::mutex slotsMutex_;     // below, never held while enqueueing or calling back
+    std::condition_variable slotFree_;
+    std::condition_variable finished_;
+    int inFlight_;
+    int callbacks_;             // finished requests whose callback has not returned
+    std::deque<std::pair<Request*, int>> finishedRequests_;
+    bool stop_;
+    std::thread callbackThread_;
+};
+
+#endif // ASYNC_BLUR_H
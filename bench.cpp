@@ -0,0 +1,1960 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <CImg.h>
+#include <unistd.h>
+
+#include "opencl.h"
+#include "async-blur.h"
+#include "blur-daemon.h"
+#include "concurrent-blur.h"
+#include "convolution.h"
+#include "filter-codegen.h"
+#include "filter-graph.h"
+#include "fixed-point.h"
+#include "reference.h"
+#include "roofline.h"
+#include "rotational-blur.h"
+#include "rotational-sweep.h"
+#include "stencil-chain.h"
+
+#ifndef BLUR_SAMPLES_DIR
+#define BLUR_SAMPLES_DIR "samples/project4Final"
+#endif
+
+// Must match p4.cl, the local memory kernels only work with 16x16 groups
+#define BLOCK_DIM 16
+
+// One input image in both layouts the kernels use
+struct BenchImage
+{
+    std::string name;
+    int width;
+    int height;
+    std::vector<float> rgba;    // interleaved float4, p4.cl and rotational blur
+    std::vector<float> plane;   // single channel, main.cpp convolution
+};
+
+struct BenchOptions
+{
+    int runs = 10;
+    int filterWidth = 5;
+    float angle = 0.05f;
+    float strength = 0.1f;
+    RotationalQuality quality = QUALITY_FINAL;
+    bool synthetic = true;
+    bool roofline = false;
+    DeviceType device = DEVICE_GPU;
+    std::string samples = BLUR_SAMPLES_DIR;
+    std::vector<std::string> images;
+};
+
+// State shared by all variants
+struct BenchContext
+{
+    cl::Context context;
+    cl::Device device;
+    cl::CommandQueue queue;
+    cl::Program p4;
+    bool p4Built = false;
+    bool imageSupport = false;
+    std::vector<float> filter;
+    Roofline roofline;
+    BenchOptions options;
+};
+
+// Outcome of one variant on one image
+struct BenchResult
+{
+    std::vector<double> times;  // kernel time of every run in ms
+    std::vector<float> output;  // same layout as the input it was computed from
+    double bytes = 0;           // minimum global memory traffic of one run
+    double flops = 0;           // arithmetic of one run, transcendentals not counted
+    double tolerance = 0;       // absolute, replaces the variant's if set
+    std::string status;         // empty if the variant ran
+};
+
+enum ReferenceType
+{
+    REFERENCE_CONVOLUTION,
+    REFERENCE_CONVOLUTION4,
+    REFERENCE_ROTATIONAL,
+    REFERENCE_SWEEP,
+    REFERENCE_ANGLE_MAP,
+    REFERENCE_ZOOM,
+    REFERENCE_GAUSSIAN,
+    REFERENCE_SHEAR,
+    REFERENCE_STENCIL_CHAIN,
+    REFERENCE_FILTER_GRAPH,
+    REFERENCE_BORDER_CLAMP,     // single channel, every pixel
+    REFERENCE_BORDER_MIRROR,
+    REFERENCE_BORDER_WRAP,
+    REFERENCE_BORDER4_CLAMP,    // float4, every pixel
+    REFERENCE_FIXED_CONVOLUTION,    // 8-bit input, every pixel, clamped to 0..1
+    REFERENCE_FIXED_ROTATIONAL,     // 8-bit input, no level of detail
+};
+
+static constexpr int ReferenceTypes = REFERENCE_FIXED_ROTATIONAL + 1;
+
+struct BenchVariant
+{
+    const char* name;
+    ReferenceType reference;
+    std::function<BenchResult(BenchContext&, BenchImage const&)> run;
+    double tolerance = 1.0e-3;  // relative to the largest reference value
+};
+
+// Argument layouts of the p4.cl kernels
+enum P4Args
+{
+    P4_TEXTURE,         // convolve
+    P4_CONSTANT,        // convolveConstant, convolveConstantLocal, anotherConvolveConstant
+    P4_GLOBAL,          // convolveGloballMem, convolveGloballMemLocal
+    P4_GLOBAL_CONSTANT, // convolveGloballMemConstant
+};
+
+// The filters project4.cpp's initFilter() sets up
+static std::vector<float> init_filter(int filterWidth)
+{
+    std::vector<float> filter(filterWidth*filterWidth, -1.0f);
+
+    if (filterWidth == 3)
+    {
+        filter = { 0.0f,  1.0f, 0.0f,
+                   1.0f, -4.0f, 1.0f,
+                   0.0f,  1.0f, 0.0f };
+    }
+    else
+    {
+        int filterRadius = filterWidth / 2;
+        filter[filterRadius*filterWidth + filterRadius] = float(filterWidth*filterWidth - 1);
+    }
+
+    return filter;
+}
+
+static double event_ms(cl::Event const& event)
+{
+    auto start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    auto end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+    return (end - start) * 1.0e-6;
+}
+
+// From the end of `first` to the end of `last`, for markers
+static double span_ms(cl::Event const& first, cl::Event const& last)
+{
+    auto start = first.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+    auto end = last.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+    return (end - start) * 1.0e-6;
+}
+
+static double median(std::vector<double> values)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+    auto middle = values.size() / 2;
+    if (values.size() % 2)
+        return values[middle];
+
+    return 0.5 * (values[middle - 1] + values[middle]);
+}
+
+static void fill_plane(BenchImage& image)
+{
+    image.plane.resize(image.width * image.height);
+    for (int i = 0; i < image.width * image.height; i++)
+        image.plane[i] = image.rgba[4*i];
+}
+
+// RGBA rounded to 8 bits, as read from an 8-bit file
+static std::vector<cl_uchar> quantize_image(std::vector<float> const& rgba)
+{
+    std::vector<cl_uchar> bytes(rgba.size());
+    for (size_t i = 0; i < rgba.size(); i++)
+        bytes[i] = cl_uchar(std::lround(std::min(std::max(rgba[i], 0.0f), 1.0f) * 255.0f));
+    return bytes;
+}
+
+static std::vector<float> dequantize_image(std::vector<cl_uchar> const& bytes)
+{
+    std::vector<float> rgba(bytes.size());
+    for (size_t i = 0; i < bytes.size(); i++)
+        rgba[i] = bytes[i] / 255.0f;
+    return rgba;
+}
+
+static BenchImage load_image(std::string const& path)
+{
+    using namespace cimg_library;
+
+    CImg<float> file(path.c_str());
+
+    BenchImage image;
+    image.name = path.substr(path.find_last_of('/') + 1);
+    image.width = file.width();
+    image.height = file.height();
+    image.rgba.resize(image.width * image.height * 4);
+
+    // CImg keeps channels planar, the kernels want them interleaved
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            float* pixel = &image.rgba[4*(y*image.width + x)];
+            for (int c = 0; c < 3; c++)
+                pixel[c] = file(x, y, 0, std::min(c, file.spectrum() - 1)) / 255.0f;
+            pixel[3] = file.spectrum() > 3 ? file(x, y, 0, 3) / 255.0f : 1.0f;
+        }
+    }
+
+    fill_plane(image);
+    return image;
+}
+
+// Deterministic noise over a gradient, sizes deliberately not multiples
+// of the work-group size
+static BenchImage synthetic_image(int width, int height)
+{
+    BenchImage image;
+    image.name = "synthetic-" + std::to_string(width) + "x" + std::to_string(height);
+    image.width = width;
+    image.height = height;
+    image.rgba.resize(width * height * 4);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                unsigned hash = (x*73856093u) ^ (y*19349663u) ^ (c*83492791u);
+                hash *= 2654435761u;
+                float noise = (hash >> 8) / float(1 << 24);
+                float gradient = float(x + y) / (width + height);
+                image.rgba[4*(y*width + x) + c] = 0.5f * (noise + gradient);
+            }
+        }
+    }
+
+    fill_plane(image);
+    return image;
+}
+
+static BenchResult run_p4(BenchContext& bench, BenchImage const& image, const char* name, P4Args args)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+
+    if (!bench.p4Built)
+    {
+        result.status = "skipped:p4.cl";
+        return result;
+    }
+    if (!bench.imageSupport)
+    {
+        result.status = "skipped:no-image-support";
+        return result;
+    }
+    // The buffer kernels index the image transposed, x*imageWidth+y
+    if ((args == P4_GLOBAL || args == P4_GLOBAL_CONSTANT) && w != h)
+    {
+        result.status = "skipped:not-square";
+        return result;
+    }
+    // convolveGloballMemConstant hard-codes a 512x512 image and a 3x3 filter
+    if (args == P4_GLOBAL_CONSTANT && (w != 512 || filterWidth != 3))
+    {
+        result.status = "skipped:512x512-3x3-only";
+        return result;
+    }
+    // The local memory tiles have a halo of 6, convolution4:tiled has not
+    if (std::string(name).find("Local") != std::string::npos && filterWidth > 6)
+    {
+        result.status = "skipped:filter-too-wide";
+        return result;
+    }
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    cl::ImageFormat format(CL_RGBA, CL_FLOAT);
+    cl::Image2D devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, format, w, h, 0,
+                              const_cast<float*>(image.rgba.data()));
+    cl::Image2D devOutputImage(context, CL_MEM_WRITE_ONLY, format, w, h);
+    cl::Sampler sampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST);
+    cl::Buffer devFilter(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bench.filter.size() * sizeof(float),
+                         bench.filter.data());
+
+    int sizes[3] = {w, h, filterWidth};
+    cl::Buffer devWidth(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int), &sizes[0]);
+    cl::Buffer devHeight(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int), &sizes[1]);
+    cl::Buffer devFilterWidth(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int), &sizes[2]);
+
+    // The local memory variant reads a whole tile past the last work-group
+    size_t padded = roundUp(w, BLOCK_DIM) + 2*BLOCK_DIM + filterWidth;
+    cl::Buffer devDataBuffer(context, CL_MEM_READ_WRITE, padded * padded * 4 * sizeof(float));
+
+    cl::Kernel kernel(bench.p4, name);
+    unsigned width = w;
+    unsigned height = h;
+    cl_uint arg = 0;
+
+    if (args == P4_GLOBAL || args == P4_GLOBAL_CONSTANT)
+        kernel.setArg(arg++, devDataBuffer);
+    kernel.setArg(arg++, devInputImage);
+    kernel.setArg(arg++, devOutputImage);
+    kernel.setArg(arg++, sampler);
+    kernel.setArg(arg++, sampler);
+    if (args == P4_CONSTANT || args == P4_GLOBAL_CONSTANT)
+    {
+        kernel.setArg(arg++, devWidth);
+        kernel.setArg(arg++, devHeight);
+        kernel.setArg(arg++, devFilter);
+        kernel.setArg(arg++, devFilterWidth);
+    }
+    else
+    {
+        kernel.setArg(arg++, w);
+        kernel.setArg(arg++, h);
+        kernel.setArg(arg++, devFilter);
+        kernel.setArg(arg++, filterWidth);
+    }
+    kernel.setArg(arg++, width);
+    kernel.setArg(arg++, height);
+
+    cl::NDRange localSize {BLOCK_DIM, BLOCK_DIM};
+    cl::NDRange globalSize {roundUp(w, BLOCK_DIM), roundUp(h, BLOCK_DIM)};
+
+    // The buffer kernels copy the texture into the buffer while counter < 2
+    unsigned counterArg = arg;
+    if (args == P4_GLOBAL || args == P4_GLOBAL_CONSTANT)
+    {
+        kernel.setArg(counterArg, 0u);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize);
+        kernel.setArg(counterArg, 2u);
+    }
+
+    // One warm up launch, then the timed ones
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize, nullptr, &event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    result.output.resize(w * h * 4);
+    cl::size_t<3> origin;
+    cl::size_t<3> region;
+    origin[0] = 0;
+    origin[1] = 0;
+    origin[2] = 0;
+    region[0] = w;
+    region[1] = h;
+    region[2] = 1;
+    queue.enqueueReadImage(devOutputImage, CL_TRUE, origin, region, 0, 0, result.output.data());
+
+    // One float4 mad per tap for every pixel the filter fits around
+    int filterRadius = filterWidth / 2;
+    result.bytes = 2.0 * w * h * 4 * sizeof(float) + bench.filter.size() * sizeof(float);
+    result.flops = 8.0 * (w - 2*filterRadius) * (h - 2*filterRadius) * filterWidth * filterWidth;
+    return result;
+}
+
+// The blur_image() path of main.cpp, built for `precision`
+static BenchResult run_convolution(BenchContext& bench, BenchImage const& image, Precision precision)
+{
+    BenchResult result;
+
+    if (convolution_precision(bench.device, precision) != precision)
+    {
+        result.status = "skipped:no-fp16";
+        return result;
+    }
+
+    int imgw = image.width;
+    int imgh = image.height;
+    int filterWidth = bench.options.filterWidth;
+    int paddingPixels = (filterWidth / 2) * 2;
+    size_t dataSize = imgw * imgh * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    cl::Program program(context, convolution_precision_source(false) + convolution_kernel_source);
+    program.build({bench.device}, convolution_precision_options(precision).c_str());
+    cl::Kernel kernel(program, "convolution");
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.plane.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+    cl::Buffer devFilter(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bench.filter.size() * sizeof(float),
+                         bench.filter.data());
+
+    cl::NDRange localSize {WGX, WGY};
+    cl::NDRange globalSize {roundUp(imgw - paddingPixels, WGX), roundUp(imgh - paddingPixels, WGY)};
+    int localWidth = localSize[0] + paddingPixels;
+    int localHeight = localSize[1] + paddingPixels;
+
+    kernel.setArg(0, devInputImage);
+    kernel.setArg(1, devOutputImage);
+    kernel.setArg(2, devFilter);
+    kernel.setArg(3, imgh);
+    kernel.setArg(4, imgw);
+    kernel.setArg(5, filterWidth);
+    kernel.setArg(6, localWidth * localHeight * sizeof(float), nullptr);
+    kernel.setArg(7, localHeight);
+    kernel.setArg(8, localWidth);
+
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize, nullptr, &event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    result.output.resize(imgw * imgh);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    result.bytes = 2.0 * dataSize + bench.filter.size() * sizeof(float);
+    result.flops = 2.0 * (imgw - paddingPixels) * (imgh - paddingPixels) * filterWidth * filterWidth;
+    return result;
+}
+
+// The split interior and border kernels on the plane (main.cpp) or on
+// the float4 image (p4.cl), with convolution_blocked as the interior
+// kernel for blocks larger than 1x1
+static BenchResult run_convolution_split(BenchContext& bench, BenchImage const& image, bool rgba, BorderMode mode,
+                                         int blockX = 1, int blockY = 1)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t pixelSize = (rgba ? 4 : 1) * sizeof(float);
+    size_t dataSize = w * h * pixelSize;
+    bool blocked = blockX * blockY > 1;
+
+    if (convolution_split_local_bytes(filterWidth, pixelSize, blockX, blockY) >
+        bench.device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>())
+    {
+        result.status = "skipped:local memory";
+        return result;
+    }
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    cl::Program program(context, convolution_split_source(rgba, blocked));
+    program.build({bench.device}, blocked ? convolution_blocked_options(blockX, blockY, filterWidth).c_str() : nullptr);
+    cl::Kernel interior(program, blocked ? "convolution_blocked" : "convolution_interior");
+    cl::Kernel border(program, "convolution_border");
+
+    auto const& input = rgba ? image.rgba : image.plane;
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(input.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+    cl::Buffer devFilter(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bench.filter.size() * sizeof(float),
+                         bench.filter.data());
+
+    enqueue_convolution_split(queue, interior, border, devInputImage, devOutputImage, devFilter,
+                              h, w, filterWidth, mode, pixelSize, nullptr, blockX, blockY);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        enqueue_convolution_split(queue, interior, border, devInputImage, devOutputImage, devFilter,
+                                  h, w, filterWidth, mode, pixelSize, &events, blockX, blockY);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(dataSize / sizeof(float));
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // Every pixel now, one mad per channel and tap
+    result.bytes = 2.0 * dataSize + bench.filter.size() * sizeof(float);
+    result.flops = 2.0 * (rgba ? 4 : 1) * w * h * filterWidth * filterWidth;
+    return result;
+}
+
+// One launch over every pixel with clamped borders: convolution_tiled
+// through its padded local memory tile or convolution_global
+static BenchResult run_convolution_tiled(BenchContext& bench, BenchImage const& image, bool rgba, bool tiled)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t pixelSize = (rgba ? 4 : 1) * sizeof(float);
+    size_t dataSize = w * h * pixelSize;
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    cl::Program program(context, convolution_split_source(rgba));
+    program.build({bench.device});
+    cl::Kernel kernel(program, tiled ? "convolution_tiled" : "convolution_global");
+
+    auto const& input = rgba ? image.rgba : image.plane;
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(input.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+    cl::Buffer devFilter(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bench.filter.size() * sizeof(float),
+                         bench.filter.data());
+
+    auto enqueue = [&](cl::Event* event)
+    {
+        if (tiled)
+        {
+            enqueue_convolution_tiled(queue, kernel, devInputImage, devOutputImage, devFilter,
+                                      h, w, filterWidth, BORDER_CLAMP, pixelSize, event);
+            return;
+        }
+
+        kernel.setArg(0, devInputImage);
+        kernel.setArg(1, devOutputImage);
+        kernel.setArg(2, devFilter);
+        kernel.setArg(3, h);
+        kernel.setArg(4, w);
+        kernel.setArg(5, filterWidth);
+        kernel.setArg(6, int(BORDER_CLAMP));
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(roundUp(w, WGX), roundUp(h, WGY)),
+                                   cl::NDRange(WGX, WGY), nullptr, event);
+    };
+
+    enqueue(nullptr);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        enqueue(&event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    result.output.resize(dataSize / sizeof(float));
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    result.bytes = 2.0 * dataSize + bench.filter.size() * sizeof(float);
+    result.flops = 2.0 * (rgba ? 4 : 1) * w * h * filterWidth * filterWidth;
+    return result;
+}
+
+// Kernel generated for the bench filter, built before the timed runs
+static BenchResult run_convolution_generated(BenchContext& bench, BenchImage const& image, bool rgba)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t dataSize = w * h * (rgba ? 4 : 1) * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    GeneratedConvolution convolution(context, rgba);
+
+    auto const& input = rgba ? image.rgba : image.plane;
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(input.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    convolution.enqueue(queue, devInputImage, devOutputImage, w, h, bench.filter, filterWidth);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        convolution.enqueue(queue, devInputImage, devOutputImage, w, h, bench.filter, filterWidth, BORDER_CLAMP,
+                            &event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    result.output.resize(dataSize / sizeof(float));
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // Every tap is still read, but a multiply only per distinct weight
+    size_t taps = 0;
+    auto terms = filter_terms(bench.filter, filterWidth);
+    for (auto const& term : terms)
+        taps += term.taps.size();
+    result.bytes = 2.0 * dataSize;
+    result.flops = double(rgba ? 4 : 1) * w * h * (taps + terms.size());
+    return result;
+}
+
+// The host code matching the generated kernel, wall clock time
+static BenchResult run_convolution_generated_host(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    auto terms = filter_terms(bench.filter, bench.options.filterWidth);
+
+    result.output.resize(image.rgba.size());
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        convolution_generated_host(terms, image.rgba.data(), result.output.data(), w, h, 4, BORDER_CLAMP);
+        auto end = std::chrono::steady_clock::now();
+        result.times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    size_t taps = 0;
+    for (auto const& term : terms)
+        taps += term.taps.size();
+    result.bytes = 2.0 * image.rgba.size() * sizeof(float);
+    result.flops = 4.0 * w * h * (taps + terms.size());
+    return result;
+}
+
+// Convolution engine forced onto the split kernels summing in half
+static BenchResult run_convolution_half(BenchContext& bench, BenchImage const& image, bool rgba)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t dataSize = w * h * (rgba ? 4 : 1) * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    Convolution convolution(context, rgba, PRECISION_HALF);
+    convolution.setRows(false);
+    if (convolution.precision() != PRECISION_HALF)
+    {
+        result.status = "skipped:no-fp16";
+        return result;
+    }
+
+    auto const& input = rgba ? image.rgba : image.plane;
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(input.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+    cl::Buffer devFilter(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bench.filter.size() * sizeof(float),
+                         bench.filter.data());
+
+    convolution.enqueue(queue, devInputImage, devOutputImage, devFilter, w, h, filterWidth);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        convolution.enqueue(queue, devInputImage, devOutputImage, devFilter, w, h, filterWidth, BORDER_CLAMP,
+                            &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(dataSize / sizeof(float));
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    result.bytes = 2.0 * dataSize + bench.filter.size() * sizeof(float);
+    result.flops = 2.0 * (rgba ? 4 : 1) * w * h * filterWidth * filterWidth;
+    return result;
+}
+
+// Convolution engine forced onto convolution_rows, the kernel it picks
+// for CPU devices; compare with :split on the same device
+static BenchResult run_convolution_rows(BenchContext& bench, BenchImage const& image, bool rgba)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t dataSize = w * h * (rgba ? 4 : 1) * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    Convolution convolution(context, rgba);
+    convolution.setRows(true);
+
+    auto const& input = rgba ? image.rgba : image.plane;
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(input.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+    cl::Buffer devFilter(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bench.filter.size() * sizeof(float),
+                         bench.filter.data());
+
+    convolution.enqueue(queue, devInputImage, devOutputImage, devFilter, w, h, filterWidth);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        convolution.enqueue(queue, devInputImage, devOutputImage, devFilter, w, h, filterWidth, BORDER_CLAMP,
+                            &events);
+        cl::Event::waitForEvents(events);
+        result.times.push_back(event_ms(events.front()));
+    }
+
+    result.output.resize(dataSize / sizeof(float));
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // The output stays in cache between taps
+    result.bytes = 2.0 * dataSize + bench.filter.size() * sizeof(float);
+    result.flops = 2.0 * (rgba ? 4 : 1) * w * h * filterWidth * filterWidth;
+    return result;
+}
+
+// Bench filter quantised to 8 bits on the 8-bit image; checked against
+// the float convolution of the same input within the filter's bound
+static BenchResult run_fixed_convolution(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t dataSize = w * h * 4 * sizeof(cl_uchar);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    FixedPointBlur blur(context);
+    auto filter = quantize_filter(bench.filter, filterWidth);
+
+    auto input = quantize_image(image.rgba);
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, input.data());
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    blur.enqueueConvolution(queue, devInputImage, devOutputImage, w, h, filter);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        blur.enqueueConvolution(queue, devInputImage, devOutputImage, w, h, filter, BORDER_CLAMP, &event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    std::vector<cl_uchar> output(dataSize);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, output.data());
+    result.output = dequantize_image(output);
+
+    result.bytes = 2.0 * dataSize + filter.weights.size();
+    result.flops = 2.0 * 4 * w * h * filterWidth * filterWidth;
+    result.tolerance = (filter.bound + 1.0e-3) / 255.0;
+    return result;
+}
+
+// Direct sampling at the bench quality on the 8-bit image
+static BenchResult run_fixed_rotational(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(cl_uchar);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    FixedPointBlur blur(context);
+
+    auto input = quantize_image(image.rgba);
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, input.data());
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    auto sampling = rotational_sampling(bench.options.quality);
+    sampling.lod = false;
+
+    blur.enqueueRotational(queue, devInputImage, devOutputImage, w, h, bench.options.angle, sampling);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        blur.enqueueRotational(queue, devInputImage, devOutputImage, w, h, bench.options.angle, sampling, &event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    std::vector<cl_uchar> output(dataSize);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, output.data());
+    result.output = dequantize_image(output);
+
+    // Per tap as run_rotational(), in 16-bit integers
+    result.bytes = 2.0 * dataSize;
+    result.flops = 44.0 * rotational_blur_samples(w, h, bench.options.angle, sampling) + 4.0 * w * h;
+    result.tolerance = (FixedPointRotationalBound + 1.0e-3) / 255.0;
+    return result;
+}
+
+// Colour conversion of the stencil chain variants
+static std::vector<float> const bench_grey_matrix = {
+    0.299f, 0.587f, 0.114f, 0.0f, 0.0f,
+    0.299f, 0.587f, 0.114f, 0.0f, 0.0f,
+    0.299f, 0.587f, 0.114f, 0.0f, 0.0f,
+    0.0f,   0.0f,   0.0f,   1.0f, 0.0f,
+};
+
+// 3x3 binomial blur, then the initFilter() filter, then grey
+static std::vector<StencilStage> bench_chain(BenchContext const& bench)
+{
+    std::vector<float> blur = { 1.0f, 2.0f, 1.0f,
+                                2.0f, 4.0f, 2.0f,
+                                1.0f, 2.0f, 1.0f };
+    for (auto& weight : blur)
+        weight /= 16.0f;
+
+    return {
+        stencil_convolution(3, blur),
+        stencil_convolution(bench.options.filterWidth, bench.filter),
+        stencil_color_matrix(bench_grey_matrix),
+    };
+}
+
+static BenchResult run_stencil_chain(BenchContext& bench, BenchImage const& image, bool fused)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    StencilChain chain(context);
+    auto stages = bench_chain(bench);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    // Also builds the kernels
+    if (fused)
+        chain.enqueue(queue, devInputImage, devOutputImage, w, h, stages);
+    else
+        chain.enqueueUnfused(queue, devInputImage, devOutputImage, w, h, stages);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        if (fused)
+        {
+            events.resize(1);
+            chain.enqueue(queue, devInputImage, devOutputImage, w, h, stages, &events.front());
+        }
+        else
+            chain.enqueueUnfused(queue, devInputImage, devOutputImage, w, h, stages, &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // Fused: one read of the input, one write of the output; unfused: the
+    // same per convolution. One float4 mad per tap, 4 dot products of 4
+    // plus offsets for the grey conversion.
+    int passes = fused && chain.fusable(stages) ? 1 : 2;
+    int taps = 9 + bench.options.filterWidth * bench.options.filterWidth;
+    result.bytes = passes * 2.0 * dataSize;
+    result.flops = (8.0 * taps + 36.0) * w * h;
+    return result;
+}
+
+// Glow-like effect of two branches, blur -> filter -> blur and
+// grey -> blur, mixed half and half
+static void bench_graph(FilterGraph& graph, StencilChain& chain, BenchContext const& bench)
+{
+    auto stages = bench_chain(bench);
+    auto stage = [&chain](StencilStage const& stage) -> FilterStage
+    {
+        return [&chain, stage](cl::CommandQueue& queue,
+                               std::vector<cl::Buffer> const& inputs,
+                               cl::Buffer& output,
+                               int width,
+                               int height)
+        {
+            chain.enqueue(queue, inputs[0], output, width, height, {stage});
+        };
+    };
+
+    int input = graph.input();
+    int sharp = graph.add(stage(stages[0]), {input});
+    sharp = graph.add(stage(stages[1]), {sharp});
+    sharp = graph.add(stage(stages[0]), {sharp});
+    int grey = graph.add(stage(stages[2]), {input});
+    grey = graph.add(stage(stages[0]), {grey});
+
+    graph.output(graph.mix(sharp, grey, 0.5f));
+}
+
+static BenchResult run_filter_graph(BenchContext& bench, BenchImage const& image, int queues)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    StencilChain chain(context);
+    FilterGraph graph(context, queues);
+    bench_graph(graph, chain, bench);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    // Also builds the kernels and allocates the pool
+    graph.enqueue(queue, {devInputImage}, {devOutputImage}, w, h);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        // Wall time on the device across all queues
+        cl::Event start;
+        cl::Event end;
+        queue.enqueueMarkerWithWaitList(nullptr, &start);
+        graph.enqueue(queue, {devInputImage}, {devOutputImage}, w, h, &end);
+        end.wait();
+        result.times.push_back(span_ms(start, end));
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // Every stage reads and writes a whole image, the mix reads two. Taps
+    // as in run_stencil_chain(), 12 FLOPs per pixel for the mix.
+    int taps = 3 * 9 + bench.options.filterWidth * bench.options.filterWidth;
+    result.bytes = 13.0 * dataSize;
+    result.flops = (8.0 * taps + 36.0 + 12.0) * w * h;
+    return result;
+}
+
+static BenchResult run_rotational(BenchContext& bench, BenchImage const& image, bool lut,
+                                  RotationalScheduling scheduling, RotationalBackend backend,
+                                  RotationalLayout layout)
+{
+    BenchResult result;
+
+    if (backend == BACKEND_IMAGE && !bench.imageSupport)
+    {
+        result.status = "skipped:no-image-support";
+        return result;
+    }
+
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    RotationalBlur blur(context);
+    // Without a budget every launch samples directly, with one the warm
+    // up launch builds the table and the timed ones hit the cache
+    if (!lut)
+        blur.lut().setBudget(0);
+    blur.setScheduling(scheduling);
+    blur.setBackend(backend);
+    blur.setLayout(layout);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    auto sampling = rotational_sampling(bench.options.quality);
+
+    blur.enqueue(queue, devInputImage, devOutputImage, w, h, bench.options.angle, sampling);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        cl::Event event;
+        blur.enqueue(queue, devInputImage, devOutputImage, w, h, bench.options.angle, sampling, &event);
+        event.wait();
+        result.times.push_back(event_ms(event));
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // Per tap: 4 for the position, 3 float4 lerps and the float4 sum, the
+    // texture unit does the lerps of the image backend for 2 to normalise.
+    // Per pixel: the final float4 divide.
+    // The table and the band schedule are read on top of the image
+    double tapFlops = backend == BACKEND_IMAGE ? 10.0 : 44.0;
+    result.bytes = 2.0 * dataSize + blur.lut().used();
+    if (scheduling == SCHEDULE_BANDS)
+        result.bytes += double(w) * h * sizeof(cl_uint);
+    result.flops = tapFlops * rotational_blur_samples(w, h, bench.options.angle, sampling) + 4.0 * w * h;
+    return result;
+}
+
+// rotational_blur() through AsyncBlur with `requests` in flight at once,
+// wall clock time per request including the transfers
+static BenchResult run_rotational_async(BenchContext& bench, BenchImage const& image, int requests)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+    float angle = bench.options.angle;
+    auto quality = bench.options.quality;
+
+    AsyncBlur blur(bench.context, requests);
+    std::vector<std::vector<float>> images(requests, image.rgba);
+
+    // Builds the kernels and the sampling table
+    if (int status = blur.rotationalBlur(images[0].data(), w, h, angle, quality).get())
+        throw cl::Error(status, "AsyncBlur::rotationalBlur");
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<std::future<int>> pending;
+        for (auto& copy : images)
+            copy = image.rgba;
+
+        auto start = std::chrono::steady_clock::now();
+        for (auto& copy : images)
+            pending.push_back(blur.rotationalBlur(copy.data(), w, h, angle, quality));
+        for (auto& request : pending)
+        {
+            if (int status = request.get())
+                throw cl::Error(status, "AsyncBlur::rotationalBlur");
+        }
+        auto end = std::chrono::steady_clock::now();
+        result.times.push_back(std::chrono::duration<double, std::milli>(end - start).count() / requests);
+    }
+
+    result.output = images.front();
+
+    auto sampling = rotational_sampling(quality);
+    result.bytes = 2.0 * dataSize;
+    result.flops = 44.0 * rotational_blur_samples(w, h, angle, sampling) + 4.0 * w * h;
+    return result;
+}
+
+// rotational_blur() through ConcurrentBlur from `callers` threads, each
+// blocking on its own requests, wall clock time per request including the
+// transfers
+static BenchResult run_rotational_threads(BenchContext& bench, BenchImage const& image, int callers)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+    float angle = bench.options.angle;
+    auto quality = bench.options.quality;
+    // Requests per caller and run
+    int const requests = 4;
+
+    ConcurrentBlur blur(bench.context, 2);
+    std::vector<std::vector<float>> images(callers, image.rgba);
+
+    // Warm-up, whichever workers take these build their sampling tables
+    for (int i = 0; i < blur.queues(); i++)
+    {
+        if (int status = blur.rotationalBlur(images[0].data(), w, h, angle, quality).get())
+            throw cl::Error(status, "ConcurrentBlur::rotationalBlur");
+    }
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<std::thread> threads;
+        std::vector<int> statuses(callers, CL_SUCCESS);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int caller = 0; caller < callers; caller++)
+        {
+            threads.emplace_back([&, caller]
+            {
+                for (int i = 0; i < requests && statuses[caller] == CL_SUCCESS; i++)
+                {
+                    images[caller] = image.rgba;
+                    statuses[caller] = blur.rotationalBlur(images[caller].data(), w, h, angle, quality).get();
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        auto end = std::chrono::steady_clock::now();
+
+        for (int status : statuses)
+        {
+            if (status)
+                throw cl::Error(status, "ConcurrentBlur::rotationalBlur");
+        }
+        result.times.push_back(std::chrono::duration<double, std::milli>(end - start).count() / (callers * requests));
+    }
+
+    result.output = images.front();
+
+    auto sampling = rotational_sampling(quality);
+    result.bytes = 2.0 * dataSize;
+    result.flops = 44.0 * rotational_blur_samples(w, h, angle, sampling) + 4.0 * w * h;
+    return result;
+}
+
+// The bench filter through a BlurDaemon on this process's context: each of
+// `clients` threads sends the plane from its own SharedImage on its own
+// connection, the daemon batches them into one launch. Wall clock time
+// per request including the socket round trip and the transfers.
+static BenchResult run_daemon_convolution(BenchContext& bench, BenchImage const& image, int clients)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    int filterWidth = bench.options.filterWidth;
+    size_t dataSize = w * h * sizeof(float);
+
+    std::string path = "/tmp/blur_bench." + std::to_string(getpid()) + ".socket";
+    BlurDaemon daemon(bench.context, path);
+
+    BlurDaemonRequest request = {};
+    request.op = DAEMON_CONVOLUTION;
+    request.width = w;
+    request.height = h;
+    request.filterWidth = filterWidth;
+    std::copy(bench.filter.begin(), bench.filter.end(), request.filter);
+
+    std::vector<std::unique_ptr<SharedImage>> images;
+    std::vector<int> sockets;
+    for (int client = 0; client < clients; client++)
+    {
+        images.emplace_back(new SharedImage(dataSize));
+        sockets.push_back(blur_daemon_connect(path));
+    }
+
+    // Connections wait in the listen backlog until the daemon runs
+    std::thread server([&daemon]
+    {
+        daemon.run();
+    });
+
+    std::vector<int> statuses(clients, CL_SUCCESS);
+    auto send = [&](int client)
+    {
+        std::copy(image.plane.begin(), image.plane.end(), images[client]->data());
+        statuses[client] = sockets[client] < 0 ? -1 : blur_daemon_call(sockets[client], request, images[client]->fd());
+    };
+
+    // Run 0 is a warm-up, its first batch may take only some of the requests
+    int failure = CL_SUCCESS;
+    for (int run = 0; run <= bench.options.runs && failure == CL_SUCCESS; run++)
+    {
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int client = 0; client < clients; client++)
+            threads.emplace_back(send, client);
+        for (auto& thread : threads)
+            thread.join();
+        auto end = std::chrono::steady_clock::now();
+
+        if (run)
+            result.times.push_back(std::chrono::duration<double, std::milli>(end - start).count() / clients);
+        for (int status : statuses)
+        {
+            if (status)
+                failure = status;
+        }
+    }
+
+    daemon.stop();
+    server.join();
+    for (int socket : sockets)
+    {
+        if (socket >= 0)
+            close(socket);
+    }
+
+    if (failure)
+        throw cl::Error(failure, "BlurDaemon");
+
+    result.output.assign(images.front()->data(), images.front()->data() + w * h);
+    result.bytes = 2.0 * dataSize;
+    result.flops = 2.0 * filterWidth * filterWidth * w * h;
+    return result;
+}
+
+// Shear backend, times are the sum over its three launches per rotation
+static BenchResult run_shear(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    RotationalBlur blur(context);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    cl::Buffer devOutputImage(context, CL_MEM_READ_WRITE, dataSize);
+
+    int rotations = rotational_shear_rotations(w, h, bench.options.angle, rotational_sampling(bench.options.quality));
+
+    blur.enqueueShear(queue, devInputImage, devOutputImage, w, h, bench.options.angle, rotations);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        blur.enqueueShear(queue, devInputImage, devOutputImage, w, h, bench.options.angle, rotations, &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // Per rotation every pass reads and writes its grid once, the grids are
+    // padded by the largest shear (taken as the image size here) and the
+    // last pass also reads the sum. Per value: 1 for the position and a
+    // float4 lerp, the accumulation a float4 mad.
+    result.bytes = rotations * (6.0 * dataSize + dataSize);
+    result.flops = rotations * (3.0 * 13.0 + 8.0) * w * h;
+    return result;
+}
+
+// Angle map of the angle map variants: from a quarter of the bench angle
+// on the left edge to 1.75 times it on the right
+static std::vector<float> bench_angle_map(BenchContext const& bench, int width, int height)
+{
+    std::vector<float> angleMap(width * height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            angleMap[y*width + x] = bench.options.angle * (0.25f + 1.5f * x / std::max(1, width - 1));
+    return angleMap;
+}
+
+static BenchResult run_angle_map(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    RotationalBlur blur(context);
+    auto sampling = rotational_sampling(bench.options.quality);
+    auto angleMap = bench_angle_map(bench, w, h);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    cl::Buffer devAngleMap(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, w * h * sizeof(float),
+                           angleMap.data());
+    cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, dataSize);
+
+    blur.enqueueAngleMap(queue, devInputImage, devOutputImage, w, h, devAngleMap, sampling);
+    queue.finish();
+
+    // Bucketing included, the read back of the bucket sizes is not
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        blur.enqueueAngleMap(queue, devInputImage, devOutputImage, w, h, devAngleMap, sampling, &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, result.output.data());
+
+    // The angle map is read twice, the pixel list written and read once.
+    // Taps are estimated from the mean angle, bucket rounding not counted.
+    double taps = 0.0;
+    for (auto angle : angleMap)
+        taps += angle;
+    taps *= rotational_blur_samples(w, h, 1.0f, sampling) / (double(w) * h);
+    result.bytes = 2.0 * dataSize + w * h * (2 * sizeof(float) + 2 * sizeof(cl_uint) + sizeof(cl_uchar));
+    result.flops = 44.0 * taps + 4.0 * w * h;
+    return result;
+}
+
+// Blurs `angles` angles up to the bench angle in one sweep, the last
+// output (the bench angle) is checked. Times are the sum over all
+// launches of a sweep, polar tables included.
+static BenchResult run_sweep(BenchContext& bench, BenchImage const& image, int angles)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    std::vector<float> sweepAngles;
+    for (int i = 1; i <= angles; i++)
+        sweepAngles.push_back(bench.options.angle * i / angles);
+
+    RotationalSweep sweep(context);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    std::vector<cl::Buffer> devOutputImages;
+    for (int i = 0; i < angles; i++)
+        devOutputImages.push_back(cl::Buffer(context, CL_MEM_WRITE_ONLY, dataSize));
+
+    RotationalPolar polar(devInputImage, w, h);
+    sweep.enqueueSpin(queue, polar, devOutputImages, sweepAngles);
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        polar.reset();
+        sweep.enqueueSpin(queue, polar, devOutputImages, sweepAngles, &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImages.back(), CL_TRUE, 0, dataSize, result.output.data());
+
+    // Input read and tables written once, per angle the tables read once
+    // and an output written. Per bin: 4 for the position, 3 float4 lerps
+    // and 6 float4 scan steps; per pixel and angle: 2 rings of about 12
+    // for the positions and 6 float4 sums, and the float4 ring blend.
+    double tables = double(polar.bytes());
+    double bins = tables / (4.0 * sizeof(float));   // table entries, about one per bin
+    result.bytes = dataSize + tables + angles * (dataSize + tables);
+    result.flops = 52.0 * bins + angles * (2.0 * (12.0 + 24.0) + 12.0) * w * h;
+    return result;
+}
+
+// Gaussian spin blur with a standard deviation of the bench angle, ring
+// tables rebuilt on every run
+static BenchResult run_gaussian(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    RotationalSweep sweep(context);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    std::vector<cl::Buffer> devOutputImages {cl::Buffer(context, CL_MEM_WRITE_ONLY, dataSize)};
+
+    RotationalPolar polar(devInputImage, w, h);
+    sweep.enqueueGaussian(queue, polar, devOutputImages, {bench.options.angle});
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        polar.reset();
+        sweep.enqueueGaussian(queue, polar, devOutputImages, {bench.options.angle}, &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImages.front(), CL_TRUE, 0, dataSize, result.output.data());
+
+    // Ring tables built as for a sweep from the input, the rings filtered
+    // as counted by rotational_sweep_gaussian_cost(), then every filtered
+    // bin read once by the resampling, which writes the output. Per pixel
+    // 2 positions of about 12 and 3 float4 lerps.
+    auto filter = rotational_sweep_gaussian_cost(w, h, bench.options.angle);
+    result.bytes = 2.0 * dataSize + double(polar.bytes()) + filter.bytes + filter.bins * 4.0 * sizeof(float);
+    result.flops = 52.0 * filter.bins + filter.flops + (2.0 * 12.0 + 36.0) * w * h;
+    return result;
+}
+
+// Zoom blur at the bench strength through the spoke tables, rebuilt on
+// every run
+static BenchResult run_zoom(BenchContext& bench, BenchImage const& image)
+{
+    BenchResult result;
+    int w = image.width;
+    int h = image.height;
+    size_t dataSize = w * h * 4 * sizeof(float);
+
+    auto& context = bench.context;
+    auto& queue = bench.queue;
+
+    RotationalSweep sweep(context);
+
+    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                             const_cast<float*>(image.rgba.data()));
+    std::vector<cl::Buffer> devOutputImages {cl::Buffer(context, CL_MEM_WRITE_ONLY, dataSize)};
+
+    RotationalPolar polar(devInputImage, w, h);
+    sweep.enqueueZoom(queue, polar, devOutputImages, {bench.options.strength});
+    queue.finish();
+
+    for (int run = 0; run < bench.options.runs; run++)
+    {
+        std::vector<cl::Event> events;
+        polar.reset();
+        sweep.enqueueZoom(queue, polar, devOutputImages, {bench.options.strength}, &events);
+        cl::Event::waitForEvents(events);
+
+        double ms = 0.0;
+        for (auto const& event : events)
+            ms += event_ms(event);
+        result.times.push_back(ms);
+    }
+
+    result.output.resize(w * h * 4);
+    queue.enqueueReadBuffer(devOutputImages.front(), CL_TRUE, 0, dataSize, result.output.data());
+
+    // Same as a sweep of one angle, with the pixel positions of spokes
+    double tables = double(polar.bytes());
+    double samples = tables / (4.0 * sizeof(float));
+    result.bytes = 2.0 * dataSize + 2.0 * tables;
+    result.flops = 52.0 * samples + (2.0 * (12.0 + 24.0) + 12.0) * w * h;
+    return result;
+}
+
+static std::vector<BenchVariant> bench_variants()
+{
+    using namespace std::placeholders;
+
+    auto p4 = [](const char* name, P4Args args)
+    {
+        return std::bind(run_p4, _1, _2, name, args);
+    };
+
+    auto split = [](bool rgba, BorderMode mode)
+    {
+        return std::bind(run_convolution_split, _1, _2, rgba, mode, 1, 1);
+    };
+
+    auto blocked = [](bool rgba, int blockX, int blockY)
+    {
+        return std::bind(run_convolution_split, _1, _2, rgba, BORDER_CLAMP, blockX, blockY);
+    };
+
+    auto rotational = [](bool lut, RotationalScheduling scheduling, RotationalBackend backend,
+                         RotationalLayout layout = LAYOUT_ROWS)
+    {
+        return std::bind(run_rotational, _1, _2, lut, scheduling, backend, layout);
+    };
+
+    return {
+        { "p4:convolve",                   REFERENCE_CONVOLUTION4, p4("convolve", P4_TEXTURE) },
+        { "p4:convolveGloballMem",         REFERENCE_CONVOLUTION4, p4("convolveGloballMem", P4_GLOBAL) },
+        { "p4:convolveConstant",           REFERENCE_CONVOLUTION4, p4("convolveConstant", P4_CONSTANT) },
+        { "p4:convolveConstantLocal",      REFERENCE_CONVOLUTION4, p4("convolveConstantLocal", P4_CONSTANT) },
+        { "p4:convolveGloballMemLocal",    REFERENCE_CONVOLUTION4, p4("convolveGloballMemLocal", P4_GLOBAL) },
+        { "p4:anotherConvolveConstant",    REFERENCE_CONVOLUTION4, p4("anotherConvolveConstant", P4_CONSTANT) },
+        { "p4:convolveGloballMemConstant", REFERENCE_CONVOLUTION4, p4("convolveGloballMemConstant", P4_GLOBAL_CONSTANT) },
+        { "main:convolution",              REFERENCE_CONVOLUTION,  std::bind(run_convolution, _1, _2, PRECISION_FLOAT) },
+        // Half sums are off by up to 1% of the largest output with 7x7 filters
+        { "main:convolution+half",         REFERENCE_CONVOLUTION,  std::bind(run_convolution, _1, _2, PRECISION_HALF), 2.0e-2 },
+        { "convolution:half",              REFERENCE_BORDER_CLAMP, std::bind(run_convolution_half, _1, _2, false), 2.0e-2 },
+        { "convolution4:half",             REFERENCE_BORDER4_CLAMP, std::bind(run_convolution_half, _1, _2, true), 2.0e-2 },
+        { "convolution:split",             REFERENCE_BORDER_CLAMP, split(false, BORDER_CLAMP) },
+        { "daemon:convolution8",           REFERENCE_BORDER_CLAMP, std::bind(run_daemon_convolution, _1, _2, 8) },
+        { "convolution:split+mirror",      REFERENCE_BORDER_MIRROR, split(false, BORDER_MIRROR) },
+        { "convolution:split+wrap",        REFERENCE_BORDER_WRAP,  split(false, BORDER_WRAP) },
+        { "convolution4:split",            REFERENCE_BORDER4_CLAMP, split(true, BORDER_CLAMP) },
+        { "convolution:tiled",             REFERENCE_BORDER_CLAMP, std::bind(run_convolution_tiled, _1, _2, false, true) },
+        { "convolution:global",            REFERENCE_BORDER_CLAMP, std::bind(run_convolution_tiled, _1, _2, false, false) },
+        { "convolution4:tiled",            REFERENCE_BORDER4_CLAMP, std::bind(run_convolution_tiled, _1, _2, true, true) },
+        { "convolution4:global",           REFERENCE_BORDER4_CLAMP, std::bind(run_convolution_tiled, _1, _2, true, false) },
+        { "convolution:rows",              REFERENCE_BORDER_CLAMP, std::bind(run_convolution_rows, _1, _2, false) },
+        { "convolution4:rows",             REFERENCE_BORDER4_CLAMP, std::bind(run_convolution_rows, _1, _2, true) },
+        // Outputs per work-item, width x height
+        { "convolution:blocked4x1",        REFERENCE_BORDER_CLAMP, blocked(false, 4, 1) },
+        { "convolution:blocked4x4",        REFERENCE_BORDER_CLAMP, blocked(false, 4, 4) },
+        { "convolution4:blocked4x1",       REFERENCE_BORDER4_CLAMP, blocked(true, 4, 1) },
+        { "convolution4:blocked2x2",       REFERENCE_BORDER4_CLAMP, blocked(true, 2, 2) },
+        { "convolution:generated",         REFERENCE_BORDER_CLAMP, std::bind(run_convolution_generated, _1, _2, false) },
+        { "convolution4:generated",        REFERENCE_BORDER4_CLAMP, std::bind(run_convolution_generated, _1, _2, true) },
+        { "convolution4:generated+host",   REFERENCE_BORDER4_CLAMP, run_convolution_generated_host },
+        { "convolution4:fixed",            REFERENCE_FIXED_CONVOLUTION, run_fixed_convolution },
+        { "stencil_chain",                 REFERENCE_STENCIL_CHAIN, std::bind(run_stencil_chain, _1, _2, true) },
+        { "stencil_chain:unfused",         REFERENCE_STENCIL_CHAIN, std::bind(run_stencil_chain, _1, _2, false) },
+        { "filter_graph",                  REFERENCE_FILTER_GRAPH, std::bind(run_filter_graph, _1, _2, 2) },
+        { "filter_graph:serial",           REFERENCE_FILTER_GRAPH, std::bind(run_filter_graph, _1, _2, 1) },
+        { "rotational_blur",               REFERENCE_ROTATIONAL,   rotational(false, SCHEDULE_ROWS, BACKEND_BUFFER) },
+        { "rotational_blur:bands",         REFERENCE_ROTATIONAL,   rotational(false, SCHEDULE_BANDS, BACKEND_BUFFER) },
+        { "rotational_blur:lut",           REFERENCE_ROTATIONAL,   rotational(true, SCHEDULE_ROWS, BACKEND_BUFFER) },
+        { "rotational_blur:lut+bands",     REFERENCE_ROTATIONAL,   rotational(true, SCHEDULE_BANDS, BACKEND_BUFFER) },
+        // Texture filtering weights have 8 bits
+        { "rotational_blur:image",         REFERENCE_ROTATIONAL,   rotational(false, SCHEDULE_ROWS, BACKEND_IMAGE), 1.0e-2 },
+        { "rotational_blur:image+bands",   REFERENCE_ROTATIONAL,   rotational(false, SCHEDULE_BANDS, BACKEND_IMAGE), 1.0e-2 },
+        { "rotational_blur:tiled",         REFERENCE_ROTATIONAL,   rotational(false, SCHEDULE_ROWS, BACKEND_BUFFER, LAYOUT_TILED) },
+        { "rotational_blur:fixed",         REFERENCE_FIXED_ROTATIONAL, run_fixed_rotational },
+        { "rotational_blur:async16",       REFERENCE_ROTATIONAL,   std::bind(run_rotational_async, _1, _2, 16) },
+        { "rotational_blur:threads4",      REFERENCE_ROTATIONAL,   std::bind(run_rotational_threads, _1, _2, 4) },
+        { "rotational_blur:shear",         REFERENCE_SHEAR,        run_shear },
+        { "rotational_blur:angle-map",     REFERENCE_ANGLE_MAP,    run_angle_map },
+        { "rotational_sweep:16",           REFERENCE_SWEEP,        std::bind(run_sweep, _1, _2, 16) },
+        { "rotational_sweep:gaussian",     REFERENCE_GAUSSIAN,     run_gaussian },
+        { "zoom_blur",                     REFERENCE_ZOOM,         run_zoom },
+    };
+}
+
+// Largest absolute error over the pixels at least `margin` away from the
+// border, and the fraction of those pixels off by more than `tolerance`
+static std::pair<double, double> compare(std::vector<float> const& reference, std::vector<float> const& output,
+                                         int width, int height, int channels, int margin, double tolerance)
+{
+    double maxError = 0.0;
+    size_t bad = 0;
+    size_t total = 0;
+
+    for (int y = margin; y < height - margin; y++)
+    {
+        for (int x = margin; x < width - margin; x++)
+        {
+            double error = 0.0;
+            for (int c = 0; c < channels; c++)
+            {
+                auto i = (y*width + x)*channels + c;
+                error = std::max(error, double(std::fabs(reference[i] - output[i])));
+            }
+            maxError = std::max(maxError, error);
+            bad += error > tolerance;
+            total++;
+        }
+    }
+
+    return {maxError, total ? double(bad) / total : 0.0};
+}
+
+static int create_context(BenchContext& bench)
+{
+    // Take the first platform that has the requested device type
+    for (auto platform : {PLATFORM_AMD, PLATFORM_NVIDIA, PLATFORM_INTEL, PLATFORM_UNKNOWN})
+    {
+        OpenCL ocl(bench.options.device);
+        if (ocl.init(platform))
+            continue;
+
+        try
+        {
+            bench.context = ocl.context();
+            auto devices = bench.context.getInfo<CL_CONTEXT_DEVICES>();
+            if (devices.empty())
+                continue;
+
+            bench.device = devices.front();
+            bench.queue = cl::CommandQueue(bench.context, bench.device, CL_QUEUE_PROFILING_ENABLE);
+            bench.imageSupport = bench.device.getInfo<CL_DEVICE_IMAGE_SUPPORT>();
+            return CL_SUCCESS;
+        }
+        catch (cl::Error err)
+        {
+        }
+    }
+
+    return CL_DEVICE_NOT_FOUND;
+}
+
+static void build_p4(BenchContext& bench)
+{
+    std::string path = bench.options.samples + "/p4.cl";
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "WARNING: cannot read " << path << ", skipping the p4.cl kernels" << std::endl;
+        return;
+    }
+
+    std::stringstream source;
+    source << file.rdbuf();
+
+    try
+    {
+        bench.p4 = cl::Program(bench.context, source.str());
+        bench.p4.build({bench.device});
+        bench.p4Built = true;
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "WARNING: p4.cl => " << err.what() << std::endl;
+        std::cerr << "BUILD INFO: " << bench.p4.getBuildInfo<CL_PROGRAM_BUILD_LOG>(bench.device) << std::endl;
+    }
+}
+
+static void usage()
+{
+    std::cerr << "usage: blur_bench [--runs N] [--filter-width 3|5|7] [--angle RADIANS] [--strength S]\n"
+                 "                  [--samples DIR] [--quality preview|draft|final] [--no-synthetic]\n"
+                 "                  [--cpu] [--roofline] [image.png ...]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    BenchContext bench;
+    auto& options = bench.options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        bool value = i + 1 < argc;
+
+        if (arg == "--runs" && value)
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--filter-width" && value)
+            options.filterWidth = std::atoi(argv[++i]) | 1;
+        else if (arg == "--angle" && value)
+            options.angle = std::atof(argv[++i]);
+        else if (arg == "--strength" && value)
+            options.strength = std::atof(argv[++i]);
+        else if (arg == "--quality" && value)
+        {
+            std::string quality(argv[++i]);
+            if (quality == "preview")
+                options.quality = QUALITY_PREVIEW;
+            else if (quality == "draft")
+                options.quality = QUALITY_DRAFT;
+            else if (quality == "final")
+                options.quality = QUALITY_FINAL;
+            else
+            {
+                usage();
+                return -1;
+            }
+        }
+        else if (arg == "--samples" && value)
+            options.samples = argv[++i];
+        else if (arg == "--no-synthetic")
+            options.synthetic = false;
+        else if (arg == "--cpu")
+            options.device = DEVICE_CPU;
+        else if (arg == "--roofline")
+            options.roofline = true;
+        else if (arg[0] == '-')
+        {
+            usage();
+            return -1;
+        }
+        else
+            options.images.push_back(arg);
+    }
+
+    if (options.images.empty())
+    {
+        for (auto size : {256, 512, 1024, 2048})
+            options.images.push_back(options.samples + "/test" + std::to_string(size) + ".png");
+    }
+
+    if (create_context(bench))
+    {
+        std::cerr << "ERROR: Cannot init OpenCL" << std::endl;
+        return -1;
+    }
+
+    std::string deviceName = bench.device.getInfo<CL_DEVICE_NAME>();
+    std::replace(deviceName.begin(), deviceName.end(), ',', ' ');
+    std::cerr << "Device: " << deviceName << std::endl;
+
+    if (options.roofline)
+    {
+        try
+        {
+            bench.roofline = measure_roofline(bench.context, bench.device, bench.queue);
+            std::cerr << "Roofline: " << bench.roofline.bandwidth * 1.0e-9 << " GB/s, "
+                      << bench.roofline.flops * 1.0e-9 << " GFLOP/s, ridge at "
+                      << bench.roofline.ridge() << " FLOP/byte" << std::endl;
+        }
+        catch (cl::Error err)
+        {
+            std::cerr << "ERROR: OpenCL => " << err.what() << ", continuing without --roofline" << std::endl;
+            options.roofline = false;
+        }
+    }
+
+    bench.filter = init_filter(options.filterWidth);
+    build_p4(bench);
+
+    std::vector<BenchImage> images;
+    for (auto const& path : options.images)
+    {
+        try
+        {
+            images.push_back(load_image(path));
+        }
+        catch (cimg_library::CImgInstanceException const&)
+        {
+            std::cerr << "WARNING: cannot load " << path << std::endl;
+        }
+    }
+    if (options.synthetic)
+    {
+        for (auto size : {333, 1000, 1536})
+            images.push_back(synthetic_image(size, size));
+    }
+
+    auto variants = bench_variants();
+
+    std::cout << "device,variant,image,width,height,filter_width,runs,median_ms,mpix_s,gb_s,max_abs_err,status";
+    if (options.roofline)
+        std::cout << ",bytes,flops,intensity,peak_gb_s,peak_gflops,roofline_gflops,achieved_gflops,roofline_pct,bound";
+    std::cout << std::endl;
+
+    // Any variant that fails or mismatches fails the run
+    bool failed = false;
+    for (auto const& image : images)
+    {
+        std::vector<float> references[ReferenceTypes];
+
+        for (auto const& variant : variants)
+        {
+            BenchResult result;
+            try
+            {
+                result = variant.run(bench, image);
+            }
+            catch (cl::Error err)
+            {
+                result.status = std::string("error:") + err.what() + "(" + std::to_string(err.err()) + ")";
+            }
+            catch (std::system_error const& err)
+            {
+                result.status = std::string("error:") + err.what();
+            }
+
+            double ms = median(result.times);
+            double maxError = 0.0;
+
+            if (result.status.empty())
+            {
+                auto& reference = references[variant.reference];
+                bool plane = variant.reference == REFERENCE_CONVOLUTION ||
+                             variant.reference == REFERENCE_BORDER_CLAMP ||
+                             variant.reference == REFERENCE_BORDER_MIRROR ||
+                             variant.reference == REFERENCE_BORDER_WRAP;
+                int channels = plane ? 1 : 4;
+                int margin = 0;
+
+                if (reference.empty())
+                {
+                    reference.assign(image.width * image.height * channels, 0.0f);
+                    switch (variant.reference)
+                    {
+                    case REFERENCE_CONVOLUTION:
+                        reference_convolution(image.plane.data(), reference.data(), image.height, image.width,
+                                              bench.filter.data(), options.filterWidth);
+                        break;
+                    case REFERENCE_CONVOLUTION4:
+                        reference_convolution4(image.rgba.data(), reference.data(), image.width, image.height,
+                                               bench.filter.data(), options.filterWidth);
+                        break;
+                    case REFERENCE_ROTATIONAL:
+                    {
+                        auto sampling = rotational_sampling(options.quality);
+                        int levels = rotational_lod_levels({image.width, image.height, options.angle, sampling});
+                        reference_rotational_blur(image.rgba.data(), reference.data(), image.width, image.height,
+                                                  options.angle, sampling.density, sampling.maxSamples, levels);
+                        break;
+                    }
+                    case REFERENCE_SWEEP:
+                        reference_rotational_sweep(image.rgba.data(), reference.data(), image.width, image.height,
+                                                   options.angle);
+                        break;
+                    case REFERENCE_ANGLE_MAP:
+                    {
+                        auto sampling = rotational_sampling(options.quality);
+                        auto angleMap = bench_angle_map(bench, image.width, image.height);
+                        reference_rotational_blur_map(image.rgba.data(), reference.data(), image.width, image.height,
+                                                      angleMap.data(), sampling.density, sampling.maxSamples);
+                        break;
+                    }
+                    case REFERENCE_GAUSSIAN:
+                        reference_rotational_gaussian(image.rgba.data(), reference.data(), image.width, image.height,
+                                                      options.angle);
+                        break;
+                    case REFERENCE_SHEAR:
+                    {
+                        int rotations = rotational_shear_rotations(image.width, image.height, options.angle,
+                                                                   rotational_sampling(options.quality));
+                        reference_rotational_shear(image.rgba.data(), reference.data(), image.width, image.height,
+                                                   options.angle, rotations);
+                        break;
+                    }
+                    case REFERENCE_STENCIL_CHAIN:
+                    {
+                        // Same stages in double, one after the other
+                        std::vector<float> temp(reference.size());
+                        auto stages = bench_chain(bench);
+                        reference_convolution4_clamped(image.rgba.data(), temp.data(), image.width, image.height,
+                                                       stages[0].weights.data(), stages[0].width);
+                        reference_convolution4_clamped(temp.data(), reference.data(), image.width, image.height,
+                                                       stages[1].weights.data(), stages[1].width);
+                        reference_color_matrix(reference.data(), reference.data(), image.width, image.height,
+                                               stages[2].weights.data());
+                        break;
+                    }
+                    case REFERENCE_FILTER_GRAPH:
+                    {
+                        // The branches of bench_graph() one stage at a time
+                        std::vector<float> sharp(reference.size());
+                        std::vector<float> grey(reference.size());
+                        std::vector<float> temp(reference.size());
+                        auto stages = bench_chain(bench);
+                        reference_convolution4_clamped(image.rgba.data(), sharp.data(), image.width, image.height,
+                                                       stages[0].weights.data(), stages[0].width);
+                        reference_convolution4_clamped(sharp.data(), temp.data(), image.width, image.height,
+                                                       stages[1].weights.data(), stages[1].width);
+                        reference_convolution4_clamped(temp.data(), sharp.data(), image.width, image.height,
+                                                       stages[0].weights.data(), stages[0].width);
+                        reference_color_matrix(image.rgba.data(), temp.data(), image.width, image.height,
+                                               stages[2].weights.data());
+                        reference_convolution4_clamped(temp.data(), grey.data(), image.width, image.height,
+                                                       stages[0].weights.data(), stages[0].width);
+                        for (size_t i = 0; i < reference.size(); i++)
+                            reference[i] = 0.5f * (sharp[i] + grey[i]);
+                        break;
+                    }
+                    case REFERENCE_BORDER_CLAMP:
+                    case REFERENCE_BORDER_MIRROR:
+                    case REFERENCE_BORDER_WRAP:
+                    {
+                        auto mode = BorderMode(BORDER_CLAMP + variant.reference - REFERENCE_BORDER_CLAMP);
+                        reference_convolution_border(image.plane.data(), reference.data(), image.width, image.height, 1,
+                                                     bench.filter.data(), options.filterWidth, mode);
+                        break;
+                    }
+                    case REFERENCE_BORDER4_CLAMP:
+                        reference_convolution_border(image.rgba.data(), reference.data(), image.width, image.height, 4,
+                                                     bench.filter.data(), options.filterWidth, BORDER_CLAMP);
+                        break;
+                    case REFERENCE_FIXED_CONVOLUTION:
+                    {
+                        auto input = dequantize_image(quantize_image(image.rgba));
+                        reference_convolution_border(input.data(), reference.data(), image.width, image.height, 4,
+                                                     bench.filter.data(), options.filterWidth, BORDER_CLAMP);
+                        for (auto& value : reference)
+                            value = std::min(std::max(value, 0.0f), 1.0f);
+                        break;
+                    }
+                    case REFERENCE_FIXED_ROTATIONAL:
+                    {
+                        auto sampling = rotational_sampling(options.quality);
+                        auto input = dequantize_image(quantize_image(image.rgba));
+                        reference_rotational_blur(input.data(), reference.data(), image.width, image.height,
+                                                  options.angle, sampling.density, sampling.maxSamples);
+                        break;
+                    }
+                    case REFERENCE_ZOOM:
+                        reference_zoom_blur(image.rgba.data(), reference.data(), image.width, image.height,
+                                            options.strength);
+                        break;
+                    }
+                }
+
+                // The convolution kernels leave the border untouched or black,
+                // the local memory ones stop one filter width short
+                if (variant.reference == REFERENCE_CONVOLUTION || variant.reference == REFERENCE_CONVOLUTION4)
+                    margin = options.filterWidth;
+
+                double scale = 1.0;
+                for (auto value : reference)
+                    scale = std::max(scale, double(std::fabs(value)));
+
+                double tolerance = result.tolerance > 0 ? result.tolerance : variant.tolerance * scale;
+                auto error = compare(reference, result.output, image.width, image.height, channels, margin, tolerance);
+                maxError = error.first;
+                // A handful of pixels may land on the other side of a rounding
+                // boundary (sample count, bilinear cell) than the reference
+                result.status = error.second <= 1.0e-4 ? "ok" : "mismatch";
+            }
+
+            failed |= result.status == "mismatch" || result.status.compare(0, 6, "error:") == 0;
+
+            double pixels = double(image.width) * image.height;
+            std::cout << deviceName << ','
+                      << variant.name << ','
+                      << image.name << ','
+                      << image.width << ','
+                      << image.height << ','
+                      << options.filterWidth << ','
+                      << result.times.size() << ','
+                      << ms << ','
+                      << (ms > 0.0 ? pixels / (ms * 1.0e3) : 0.0) << ','
+                      << (ms > 0.0 ? result.bytes / (ms * 1.0e6) : 0.0) << ','
+                      << maxError << ','
+                      << result.status;
+
+            if (options.roofline)
+            {
+                auto& roofline = bench.roofline;
+                double intensity = result.bytes > 0 ? result.flops / result.bytes : 0.0;
+                double attainable = roofline.attainable(intensity);
+                double achieved = ms > 0.0 ? result.flops / (ms * 1.0e-3) : 0.0;
+
+                std::cout << ','
+                          << result.bytes << ','
+                          << result.flops << ','
+                          << intensity << ','
+                          << roofline.bandwidth * 1.0e-9 << ','
+                          << roofline.flops * 1.0e-9 << ','
+                          << attainable * 1.0e-9 << ','
+                          << achieved * 1.0e-9 << ','
+                          << (attainable > 0.0 ? 100.0 * achieved / attainable : 0.0) << ','
+                          << (intensity < roofline.ridge() ? "memory" : "compute");
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "blur-daemon.h"
+#include "convolution.h"
+
+// Largest image side the daemon accepts
+static constexpr int DaemonMaxSide = 16384;
+// Messages read from one connection per poll round, so that a busy client
+// cannot keep the others waiting
+static constexpr int DaemonMaxReceive = 4;
+static constexpr float DaemonMaxAngle = 6.28318530717958647692f;
+
+static sockaddr_un daemon_address(std::string const& path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path)
+        throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+size_t blur_daemon_image_size(BlurDaemonRequest const& request)
+{
+    if (request.width < 1 || request.height < 1 || request.width > DaemonMaxSide || request.height > DaemonMaxSide)
+        return 0;
+
+    size_t pixels = size_t(request.width) * request.height;
+    switch (request.op)
+    {
+    case DAEMON_ROTATIONAL_BLUR:
+        // QUALITY_FINAL has no sample cap, samples grow with the angle
+        if (request.quality < QUALITY_PREVIEW || request.quality > QUALITY_FINAL ||
+            !std::isfinite(request.angle) || std::fabs(request.angle) > DaemonMaxAngle)
+            return 0;
+        return pixels * 4 * sizeof(float);
+    case DAEMON_CONVOLUTION:
+        if (request.filterWidth < 1 || request.filterWidth > DaemonMaxFilterWidth || !(request.filterWidth & 1))
+            return 0;
+        return pixels * sizeof(float);
+    default:
+        return 0;
+    }
+}
+
+SharedImage::SharedImage(size_t size) :
+    fd_ (-1),
+    data_ (nullptr),
+    size_ (size)
+{
+    fd_ = memfd_create("blur-image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd_ < 0)
+        throw std::system_error(errno, std::generic_category(), "SharedImage");
+
+    // Sealed against shrinking, which the daemon requires
+    void* data = MAP_FAILED;
+    if (ftruncate(fd_, size_) == 0 && fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK) == 0)
+        data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED)
+    {
+        int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::generic_category(), "SharedImage");
+    }
+
+    data_ = static_cast<float*>(data);
+}
+
+SharedImage::~SharedImage()
+{
+    munmap(data_, size_);
+    close(fd_);
+}
+
+int blur_daemon_connect(std::string const& path)
+{
+    try
+    {
+        auto address = daemon_address(path);
+
+        int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "socket");
+
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address))
+        {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+
+        return fd;
+    }
+    catch (std::system_error const& err)
+    {
+        std::cerr << "ERROR: blur daemon => " << err.what() << std::endl;
+        return -1;
+    }
+}
+
+int blur_daemon_call(int socket, BlurDaemonRequest const& request, int imageFd)
+{
+    iovec data = {const_cast<BlurDaemonRequest*>(&request), sizeof request};
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof control);
+
+    msghdr message;
+    std::memset(&message, 0, sizeof message);
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof control.buffer;
+
+    cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(rights), &imageFd, sizeof(int));
+
+    BlurDaemonReply reply;
+    ssize_t received = -1;
+    if (sendmsg(socket, &message, MSG_NOSIGNAL) == ssize_t(sizeof request))
+    {
+        do
+            received = recv(socket, &reply, sizeof reply, 0);
+        while (received < 0 && errno == EINTR);
+    }
+
+    if (received != ssize_t(sizeof reply))
+    {
+        std::cerr << "ERROR: blur daemon => " << (received == 0 ? "connection closed" : std::strerror(errno))
+                  << std::endl;
+        return -1;
+    }
+
+    return reply.status;
+}
+
+BlurDaemon::BlurDaemon(cl::Context const& context, std::string const& path, std::chrono::microseconds window,
+                       int maxBatch) :
+    context_ (context),
+    queue_ (),
+    rotational_ (context),
+    batchKernel_ (),
+    path_ (path),
+    window_ (window),
+    maxBatch_ (std::max(maxBatch, 1)),
+    listen_ (-1),
+    wake_ {-1, -1},
+    nextConnection_ (0),
+    connections_ (),
+    batches_ ()
+{
+    queue_ = rotational_.queue();
+
+    auto device = rotational_.device();
+    cl::Program program(context_, convolution_batch_source(false));
+    try
+    {
+        program.build({device});
+    }
+    catch (cl::Error const&)
+    {
+        std::cerr << "BUILD INFO: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+        throw;
+    }
+    batchKernel_ = cl::Kernel(program, "convolution_batch");
+
+    auto address = daemon_address(path_);
+
+    // Only a socket left behind by a daemon that died is replaced: nobody
+    // listens on it any more, so connecting is refused
+    struct stat info;
+    if (lstat(path_.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (probe < 0)
+            throw std::system_error(errno, std::generic_category(), "socket");
+
+        int error = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof address) ? errno : 0;
+        close(probe);
+        if (error != ECONNREFUSED)
+            throw std::system_error(EADDRINUSE, std::generic_category(), path_);
+
+        unlink(path_.c_str());
+    }
+
+    auto fail = [this](char const* what)
+    {
+        int error = errno;
+        if (listen_ >= 0)
+            close(listen_);
+        throw std::system_error(error, std::generic_category(), what);
+    };
+
+    listen_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listen_ < 0)
+        fail("socket");
+    if (bind(listen_, reinterpret_cast<sockaddr*>(&address), sizeof address))
+        fail(path_.c_str());
+    if (listen(listen_, SOMAXCONN) || pipe2(wake_, O_CLOEXEC | O_NONBLOCK))
+    {
+        unlink(path_.c_str());
+        fail("listen");
+    }
+}
+
+BlurDaemon::~BlurDaemon()
+{
+    for (auto& batch : batches_)
+    {
+        for (auto& pending : batch.second.requests)
+            close(pending.imageFd);
+    }
+    for (auto& connection : connections_)
+        close(connection.second);
+
+    close(listen_);
+    close(wake_[0]);
+    close(wake_[1]);
+    unlink(path_.c_str());
+}
+
+void BlurDaemon::stop()
+{
+    char byte = 0;
+    ssize_t written = write(wake_[1], &byte, 1);
+    (void)written;
+}
+
+void BlurDaemon::run()
+{
+    bool stopping = false;
+    while (!stopping)
+    {
+        std::vector<pollfd> fds = {{wake_[0], POLLIN, 0}, {listen_, POLLIN, 0}};
+        std::vector<uint64_t> ids;
+        for (auto const& connection : connections_)
+        {
+            fds.push_back({connection.second, POLLIN, 0});
+            ids.push_back(connection.first);
+        }
+
+        // Sleeps until the earliest batch is due
+        auto now = std::chrono::steady_clock::now();
+        timespec timeout = {0, 0};
+        bool due = !batches_.empty();
+        if (due)
+        {
+            auto earliest = std::min_element(batches_.begin(), batches_.end(), [](auto const& a, auto const& b)
+            {
+                return a.second.deadline < b.second.deadline;
+            })->second.deadline;
+            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::max(earliest - now, std::chrono::steady_clock::duration::zero()));
+            timeout.tv_sec = wait.count() / 1000000000;
+            timeout.tv_nsec = wait.count() % 1000000000;
+        }
+
+        if (ppoll(fds.data(), fds.size(), due ? &timeout : nullptr, nullptr) < 0)
+        {
+            if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "ppoll");
+            continue;
+        }
+
+        if (fds[0].revents)
+        {
+            char bytes[16];
+            while (read(wake_[0], bytes, sizeof bytes) > 0)
+                ;
+            stopping = true;
+        }
+        if (fds[1].revents & POLLIN)
+            accept();
+
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            if (fds[i + 2].revents && !receive(ids[i], fds[i + 2].fd))
+            {
+                close(fds[i + 2].fd);
+                connections_.erase(ids[i]);
+            }
+        }
+
+        now = std::chrono::steady_clock::now();
+        for (auto batch = batches_.begin(); batch != batches_.end();)
+        {
+            if (stopping || batch->second.deadline <= now)
+            {
+                runBatch(batch->second);
+                batch = batches_.erase(batch);
+            }
+            else
+                ++batch;
+        }
+    }
+}
+
+void BlurDaemon::accept()
+{
+    for (;;)
+    {
+        int socket = accept4(listen_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (socket < 0)
+            return;
+        connections_[nextConnection_++] = socket;
+    }
+}
+
+bool BlurDaemon::receive(uint64_t connection, int socket)
+{
+    for (int messages = 0; messages < DaemonMaxReceive; messages++)
+    {
+        BlurDaemonRequest request;
+        iovec data = {&request, sizeof request};
+        union
+        {
+            char buffer[CMSG_SPACE(sizeof(int))];
+            cmsghdr align;
+        } control;
+
+        msghdr message;
+        std::memset(&message, 0, sizeof message);
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof control.buffer;
+
+        ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+        if (received == 0)
+            return false;
+        if (received < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        // Every descriptor received is now ours, also those of a request
+        // that is rejected: keep the first, close the others
+        int imageFd = -1;
+        int descriptors = 0;
+        for (cmsghdr* rights = CMSG_FIRSTHDR(&message); rights; rights = CMSG_NXTHDR(&message, rights))
+        {
+            if (rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++)
+            {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(rights) + i * sizeof(int), sizeof(int));
+                if (descriptors++ == 0)
+                    imageFd = fd;
+                else
+                    close(fd);
+            }
+        }
+
+        // The image must be sealed against shrinking, or a client could
+        // truncate it after this check and the copies from the mapping
+        // would raise SIGBUS
+        struct stat info;
+        size_t size = blur_daemon_image_size(request);
+        int seals = descriptors == 1 ? fcntl(imageFd, F_GET_SEALS) : -1;
+        if (received != ssize_t(sizeof request) || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+            descriptors != 1 || !size || seals < 0 || !(seals & F_SEAL_SHRINK) ||
+            fstat(imageFd, &info) || size_t(info.st_size) < size)
+        {
+            if (imageFd >= 0)
+                close(imageFd);
+            reply(connection, CL_INVALID_VALUE);
+            continue;
+        }
+
+        // Fields the op does not use take no part in the batch key
+        if (request.op == DAEMON_CONVOLUTION)
+        {
+            request.angle = 0.0f;
+            request.quality = 0;
+            std::fill(request.filter + request.filterWidth * request.filterWidth, std::end(request.filter), 0.0f);
+        }
+        else
+        {
+            request.filterWidth = 0;
+            std::fill(std::begin(request.filter), std::end(request.filter), 0.0f);
+        }
+
+        std::string key(reinterpret_cast<char const*>(&request), sizeof request);
+        auto& batch = batches_[key];
+        if (batch.requests.empty())
+            batch.deadline = std::chrono::steady_clock::now() + window_;
+        batch.requests.push_back({connection, request, imageFd});
+
+        if (int(batch.requests.size()) >= maxBatch_)
+        {
+            runBatch(batch);
+            batches_.erase(key);
+        }
+    }
+
+    // Messages left are read in the next round, poll reports them again
+    return true;
+}
+
+void BlurDaemon::runBatch(Batch& batch)
+{
+    auto const& request = batch.requests.front().request;
+    int width = request.width;
+    int height = request.height;
+    size_t size = blur_daemon_image_size(request);
+
+    std::vector<int> statuses(batch.requests.size(), CL_SUCCESS);
+    std::vector<float*> images;
+    std::vector<size_t> mapped;
+    for (size_t i = 0; i < batch.requests.size(); i++)
+    {
+        void* image = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, batch.requests[i].imageFd, 0);
+        if (image == MAP_FAILED)
+        {
+            statuses[i] = CL_MAP_FAILURE;
+            continue;
+        }
+        images.push_back(static_cast<float*>(image));
+        mapped.push_back(i);
+    }
+
+    // Fails every mapped request of the batch, whose reads may still be
+    // running
+    auto fail = [&](int status)
+    {
+        try
+        {
+            queue_.finish();
+        }
+        catch (cl::Error const&)
+        {
+        }
+        for (size_t i : mapped)
+            statuses[i] = status;
+    };
+
+    try
+    {
+        int count = int(images.size());
+        if (count)
+        {
+            cl::Buffer devInputImages(context_, CL_MEM_READ_ONLY, count * size);
+            cl::Buffer devOutputImages(context_, CL_MEM_WRITE_ONLY, count * size);
+
+            for (int i = 0; i < count; i++)
+                queue_.enqueueWriteBuffer(devInputImages, CL_FALSE, i * size, size, images[i]);
+            if (request.op == DAEMON_CONVOLUTION)
+            {
+                int filterWidth = request.filterWidth;
+                cl::Buffer devFilter(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                     filterWidth * filterWidth * sizeof(float), const_cast<float*>(request.filter));
+                enqueue_convolution_batch(queue_, batchKernel_, devInputImages, devOutputImages, devFilter, width,
+                                          height, count, filterWidth);
+            }
+            else
+            {
+                rotational_.enqueueBatch(queue_, devInputImages, devOutputImages, width, height, count, request.angle,
+                                         rotational_sampling(RotationalQuality(request.quality)));
+            }
+            for (int i = 0; i < count; i++)
+                queue_.enqueueReadBuffer(devOutputImages, CL_FALSE, i * size, size, images[i]);
+            queue_.finish();
+        }
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        fail(err.err());
+    }
+    catch (std::bad_alloc const&)
+    {
+        std::cerr << "ERROR: blur daemon => out of memory" << std::endl;
+        fail(CL_OUT_OF_HOST_MEMORY);
+    }
+    catch (std::exception const& err)
+    {
+        std::cerr << "ERROR: blur daemon => " << err.what() << std::endl;
+        fail(CL_INVALID_OPERATION);
+    }
+
+    for (auto image : images)
+        munmap(image, size);
+    for (size_t i = 0; i < batch.requests.size(); i++)
+    {
+        close(batch.requests[i].imageFd);
+        reply(batch.requests[i].connection, statuses[i]);
+    }
+}
+
+void BlurDaemon::reply(uint64_t connection, int status)
+{
+    auto found = connections_.find(connection);
+    if (found == connections_.end())
+        return;
+
+    // A client that does not read its replies loses them, not the daemon
+    BlurDaemonReply reply = {status};
+    send(found->second, &reply, sizeof reply, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
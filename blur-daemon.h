@@ -0,0 +1,150 @@
+#ifndef BLUR_DAEMON_H
+#define BLUR_DAEMON_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "opencl.h"
+#include "rotational-blur.h"
+
+// Local blur service: `blur_test --daemon SOCKET` keeps one OpenCL context
+// with built programs and serves requests over a Unix domain socket
+// (SOCK_SEQPACKET), so a client pays neither platform discovery nor
+// program builds per image.
+//
+// A request is one BlurDaemonRequest message carrying the descriptor of
+// the image (SCM_RIGHTS), a memfd sealed with F_SEAL_SHRINK such as a
+// SharedImage; other descriptors are rejected. The daemon maps it,
+// uploads from and reads the result back into the mapping, the pixels
+// never go through the socket. The reply, one BlurDaemonReply, comes once
+// the result is in the image.
+//
+// Requests that agree on everything but their image and arrive within the
+// batching window of the first of them run as one batch, a single launch
+// over the stacked images (convolution_batch, RotationalBlur::enqueueBatch).
+// Rotational blurs are limited to angles of at most 2 pi.
+
+enum BlurDaemonOp : int32_t
+{
+    DAEMON_ROTATIONAL_BLUR,     // interleaved float4, in place
+    DAEMON_CONVOLUTION,         // single channel float, in place, taps clamped
+};
+
+static constexpr int DaemonMaxFilterWidth = 15;
+
+// Every field 4 bytes, no padding: the daemon batches by comparing bytes
+struct BlurDaemonRequest
+{
+    int32_t op;
+    int32_t width;
+    int32_t height;
+    float angle;                // DAEMON_ROTATIONAL_BLUR
+    int32_t quality;            // RotationalQuality
+    int32_t filterWidth;        // DAEMON_CONVOLUTION, odd
+    float filter[DaemonMaxFilterWidth * DaemonMaxFilterWidth];
+};
+
+struct BlurDaemonReply
+{
+    int32_t status;             // CL_SUCCESS or an OpenCL error code
+};
+
+// Bytes of the image of `request`, 0 if its op or size is invalid
+size_t blur_daemon_image_size(BlurDaemonRequest const& request);
+
+// Anonymous shared memory (memfd) mapped into this process, sealed
+// against shrinking, to be passed to the daemon by its descriptor. Throws
+// std::system_error.
+struct SharedImage
+{
+    SharedImage(size_t size);
+    ~SharedImage();
+
+    SharedImage(SharedImage const&) = delete;
+    SharedImage& operator=(SharedImage const&) = delete;
+
+    int fd() const
+    {
+        return fd_;
+    }
+
+    float* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    int fd_;
+    float* data_;
+    size_t size_;
+};
+
+// Socket connected to the daemon at `path`, -1 on failure
+int blur_daemon_connect(std::string const& path);
+
+// Sends `request` with `imageFd` and waits for the reply. Returns its
+// status, -1 if the connection failed. Requests on one connection are
+// answered in the order of their batches, use a connection per thread.
+int blur_daemon_call(int socket, BlurDaemonRequest const& request, int imageFd);
+
+struct BlurDaemon
+{
+    // Listens at `path`, replacing a stale socket file but failing with
+    // EADDRINUSE if a daemon still listens on it. Builds all programs
+    // before it returns. Throws std::system_error or cl::Error.
+    BlurDaemon(cl::Context const& context, std::string const& path,
+               std::chrono::microseconds window = std::chrono::microseconds(2000), int maxBatch = 16);
+
+    // Closes all connections and removes the socket file
+    ~BlurDaemon();
+
+    // Serves until stop(). Requests still waiting for their batch run
+    // before it returns.
+    void run();
+
+    // Safe from any thread and from signal handlers
+    void stop();
+
+private:
+    struct Pending
+    {
+        uint64_t connection;
+        BlurDaemonRequest request;
+        int imageFd;
+    };
+
+    struct Batch
+    {
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<Pending> requests;
+    };
+
+    void accept();
+    // False once the peer hung up
+    bool receive(uint64_t connection, int socket);
+    void runBatch(Batch& batch);
+    void reply(uint64_t connection, int status);
+
+    cl::Context context_;
+    cl::CommandQueue queue_;
+    RotationalBlur rotational_;
+    cl::Kernel batchKernel_;
+    std::string path_;
+    std::chrono::microseconds window_;
+    int maxBatch_;
+    int listen_;
+    int wake_[2];               // stop() writes to the pipe
+    uint64_t nextConnection_;
+    std::map<uint64_t, int> connections_;   // id to socket, ids never reused
+    std::map<std::string, Batch> batches_;  // by request bytes
+};
+
+#endif // BLUR_DAEMON_H
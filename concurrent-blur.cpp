@@ -0,0 +1,141 @@
+#include <iostream>
+
+#include "concurrent-blur.h"
+
+static constexpr unsigned PixelSize = 16;
+
+ConcurrentBlur::ConcurrentBlur(cl::Context const& context, int queues, size_t capacity) :
+    context_ (context),
+    workers_ (),
+    jobs_ (capacity),
+    idleMutex_ (),
+    wake_ (),
+    sleeping_ (0),
+    stop_ (false)
+{
+    if (queues < 1 || capacity < 1)
+        throw cl::Error(CL_INVALID_VALUE, "ConcurrentBlur");
+
+    // Engines first, so that a failed build throws before any thread runs
+    for (int i = 0; i < queues; i++)
+    {
+        std::unique_ptr<Worker> worker(new Worker);
+        worker->rotational.reset(new RotationalBlur(context_));
+        worker->convolution.reset(new Convolution(context_));
+        worker->queue = worker->rotational->queue();
+        workers_.push_back(std::move(worker));
+    }
+
+    for (auto& worker : workers_)
+    {
+        Worker* current = worker.get();
+        worker->thread = std::thread([this, current]
+        {
+            work(*current);
+        });
+    }
+}
+
+ConcurrentBlur::~ConcurrentBlur()
+{
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        stop_ = true;
+        wake_.notify_all();
+    }
+
+    for (auto& worker : workers_)
+        worker->thread.join();
+}
+
+void ConcurrentBlur::work(Worker& worker)
+{
+    for (;;)
+    {
+        Job* job = nullptr;
+        if (!jobs_.pop(job))
+        {
+            std::unique_lock<std::mutex> lock(idleMutex_);
+            if (stop_ && jobs_.empty())
+                return;
+
+            // Counted before the queue is checked again: a push either
+            // lands before that check or sees the sleeper and notifies
+            sleeping_++;
+            wake_.wait(lock, [this]
+            {
+                return stop_ || !jobs_.empty();
+            });
+            sleeping_--;
+            continue;
+        }
+
+        try
+        {
+            job->run(worker);
+            job->result.set_value(CL_SUCCESS);
+        }
+        catch (cl::Error err)
+        {
+            std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+            job->result.set_value(err.err());
+        }
+        delete job;
+    }
+}
+
+std::future<int> ConcurrentBlur::push(std::function<void(Worker& worker)> run)
+{
+    auto job = new Job {std::move(run), std::promise<int>()};
+    auto result = job->result.get_future();
+
+    while (!jobs_.push(job))
+        std::this_thread::yield();
+
+    // Orders the push before the load of sleeping_, pairs with the
+    // worker's increment before it checks the queue
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_ > 0)
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        wake_.notify_one();
+    }
+
+    return result;
+}
+
+std::future<int> ConcurrentBlur::rotationalBlur(float* image, int width, int height, float angle,
+                                                RotationalQuality quality)
+{
+    return push([this, image, width, height, angle, quality](Worker& worker)
+    {
+        size_t dataSize = size_t(width) * height * PixelSize;
+
+        cl::Buffer devInputImage(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, image);
+        cl::Buffer devOutputImage(context_, CL_MEM_WRITE_ONLY, dataSize);
+
+        worker.rotational->enqueue(worker.queue, devInputImage, devOutputImage, width, height, angle,
+                                   rotational_sampling(quality));
+        worker.queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, image);
+    });
+}
+
+std::future<int> ConcurrentBlur::convolution(float const* in, float* out, int width, int height,
+                                             std::vector<float> const& filter, int filterWidth)
+{
+    // The filter is copied, the images are not
+    return push([this, in, out, width, height, filter, filterWidth](Worker& worker)
+    {
+        size_t dataSize = size_t(width) * height * sizeof(float);
+
+        cl::Buffer devInputImage(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize,
+                                 const_cast<float*>(in));
+        cl::Buffer devOutputImage(context_, CL_MEM_WRITE_ONLY, dataSize);
+        cl::Buffer devFilter(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filter.size() * sizeof(float),
+                             const_cast<float*>(filter.data()));
+
+        worker.convolution->enqueue(worker.queue, devInputImage, devOutputImage, devFilter, width, height,
+                                    filterWidth);
+        worker.queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, dataSize, out);
+    });
+}
@@ -0,0 +1,82 @@
+#ifndef CONCURRENT_BLUR_H
+#define CONCURRENT_BLUR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "opencl.h"
+#include "convolution.h"
+#include "lock-free-queue.h"
+#include "rotational-blur.h"
+
+// Blur engine for any number of caller threads at once.
+//
+// Callers push jobs onto a lock-free queue and get a std::future for the
+// status. A fixed set of worker threads, one per command queue, takes the
+// jobs off: each worker owns its queue and its own RotationalBlur and
+// Convolution, whose kernel objects no other thread ever touches, so no
+// setArg() can race and no caller ever takes a lock on the way in. A
+// worker uploads, runs and reads back one job at a time; with `queues`
+// workers that many jobs overlap on the device.
+//
+// Throughput grows with the number of callers until every worker is busy,
+// then with `queues` until the device saturates. Pushing onto a full
+// queue yields until a worker makes room.
+struct ConcurrentBlur
+{
+    // Builds the programs of every worker before it returns
+    ConcurrentBlur(cl::Context const& context, int queues = 2, size_t capacity = 256);
+
+    // Runs the jobs already pushed, then stops the workers
+    ~ConcurrentBlur();
+
+    // Blurs `image`, interleaved float4, in place. `image` must stay valid
+    // until the future is ready.
+    std::future<int> rotationalBlur(float* image, int width, int height, float angle,
+                                    RotationalQuality quality = QUALITY_FINAL);
+
+    // Single channel, every pixel, taps clamped to the image
+    std::future<int> convolution(float const* in, float* out, int width, int height,
+                                 std::vector<float> const& filter, int filterWidth);
+
+    int queues() const
+    {
+        return int(workers_.size());
+    }
+
+private:
+    struct Worker
+    {
+        cl::CommandQueue queue;
+        std::unique_ptr<RotationalBlur> rotational;
+        std::unique_ptr<Convolution> convolution;
+        std::thread thread;
+    };
+
+    struct Job
+    {
+        // Enqueues on the worker's queue and waits, throws cl::Error
+        std::function<void(Worker& worker)> run;
+        std::promise<int> result;
+    };
+
+    std::future<int> push(std::function<void(Worker& worker)> run);
+    void work(Worker& worker);
+
+    cl::Context context_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    LockFreeQueue<Job*> jobs_;
+    // Only for idle workers to sleep on, pushes lock it when one does
+    std::mutex idleMutex_;
+    std::condition_variable wake_;
+    std::atomic<int> sleeping_;
+    std::atomic<bool> stop_;
+};
+
+#endif // CONCURRENT_BLUR_H
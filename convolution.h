@@ -0,0 +1,871 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "opencl.h"
+
+constexpr unsigned WGX(16);
+constexpr unsigned WGY(16);
+
+// This function takes a positive integer and rounds it up to
+// the nearest multiple of another provided integer
+inline unsigned int roundUp(unsigned value, unsigned multiple) 
+{
+    // Determine how far past the nearest multiple the value is
+    auto remainder = value % multiple;
+    // Add the difference to make the value a multiple
+    if(remainder != 0) 
+    {
+        value += (multiple - remainder);
+    }
+    
+    return value;
+}
+
+// Arithmetic of the convolution sums. PRECISION_HALF multiplies and
+// accumulates in half (cl_khr_fp16), twice the rate of float on GPUs with
+// fast fp16, for an error of a few 1e-3 of the largest output (about
+// 3e-3 with 7x7 filters); images and filters stay float in memory.
+enum Precision
+{
+    PRECISION_FLOAT,
+    PRECISION_HALF,
+};
+
+// Types the kernels sum in, selected by the build option HALF_PRECISION
+// (see convolution_precision_options()): acc_t, float or float4 (`rgba`)
+// or their half counterparts, and weight_t for the taps, with
+// convert_acc() from pixels to acc_t and convert_pixel() back.
+inline std::string convolution_precision_source(bool rgba)
+{
+    std::string pixel = rgba ? "float4" : "float";
+    std::string half = rgba ? "half4" : "half";
+    return "#ifdef HALF_PRECISION\n"
+           "#pragma OPENCL EXTENSION cl_khr_fp16 : enable\n"
+           "typedef half weight_t;\n"
+           "typedef " + half + " acc_t;\n"
+           "#define convert_acc convert_" + half + "\n"
+           "#define convert_pixel convert_" + pixel + "\n"
+           "#else\n"
+           "typedef float weight_t;\n"
+           "typedef " + pixel + " acc_t;\n"
+           "#define convert_acc(x) (x)\n"
+           "#define convert_pixel(x) (x)\n"
+           "#endif\n";
+}
+
+// `requested` if the device can do it, float otherwise
+inline Precision convolution_precision(cl::Device const& device, Precision requested)
+{
+    if (requested == PRECISION_HALF &&
+        device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp16") == std::string::npos)
+        return PRECISION_FLOAT;
+
+    return requested;
+}
+
+// Build options of a program with convolution_precision_source()
+inline std::string convolution_precision_options(Precision precision)
+{
+    return precision == PRECISION_HALF ? "-D HALF_PRECISION" : "";
+}
+
+// Single channel 2D convolution through a local memory tile, one
+// output pixel per work-item. Shared by blur_test and blur_bench.
+// Prefixed with convolution_precision_source(false).
+static const std::string convolution_kernel_source = KERNEL_SOURCE(
+    __kernel void convolution(__global float* imageIn, 
+                              __global float* imageOut,
+                              __constant float* filter,
+                              int rows,
+                              int cols,
+                              int filterWidth,
+                              __local float* localImage,
+                              int localHeight,
+                              int localWidth)
+    {
+        // Determine the amount of padding for this filter
+        int filterRadius = filterWidth / 2;
+        int padding = filterRadius * 2;
+        
+        // Determine the size of the workgroup output region
+        int groupStartCol = get_group_id(0)*get_local_size(0);
+        int groupStartRow = get_group_id(1)*get_local_size(1);
+        
+        // Determine the local ID of each work-item
+        int localCol = get_local_id(0);
+        int localRow = get_local_id(1);
+
+        // Determine the global ID of each work-item. work-items
+        // representing the output region will have a unique global
+        // ID
+        int globalCol = groupStartCol + localCol;
+        int globalRow = groupStartRow + localRow;
+
+        // Cache the data to local memory
+        // Step down rows
+        for (int i = localRow; i < localHeight; i += get_local_size(1)) 
+        {
+            int curRow = groupStartRow + i;
+            // Step across columns
+            for (int j = localCol; j < localWidth; j += get_local_size(0)) 
+            {
+                int curCol = groupStartCol + j;
+                
+                // Perform the read if it is in bounds
+                if (curRow < rows && curCol < cols)
+                {
+                    localImage[i*localWidth + j] = imageIn[curRow*cols+curCol];
+                }
+            }
+        }
+        
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Perform the convolution
+        if (globalRow < rows-padding && globalCol < cols-padding) 
+        {
+            // Each work-item will filter around its start location
+            //(starting from the filter radius left and up)
+            acc_t sum = 0.0f;
+            int filterIdx = 0;
+            // Not unrolled
+            for (int i = localRow; i < localRow+filterWidth; i++) 
+            {
+                int offset = i*localWidth;
+                for (int j = localCol; j < localCol+filterWidth; j++)
+                {
+                    sum += convert_acc(localImage[offset+j]) * (weight_t)filter[filterIdx++];
+                }
+            }
+            
+            /*
+            // Inner loop unrolled
+            for (int i = localRow; i < localRow+filterWidth; i++) 
+            {
+                int offset = i*localWidth+localCol;
+                sum += localImage[offset++] * filter[filterIdx++];
+                sum += localImage[offset++] * filter[filterIdx++];
+                sum += localImage[offset++] * filter[filterIdx++];
+                sum += localImage[offset++] * filter[filterIdx++];
+                sum += localImage[offset++] * filter[filterIdx++];
+                sum += localImage[offset++] * filter[filterIdx++];
+                sum += localImage[offset++] * filter[filterIdx++];
+            }
+            */
+            
+            // Write the data out
+            imageOut[(globalRow+filterRadius)*cols + (globalCol+filterRadius)] = convert_pixel(sum);
+        }
+
+        return;
+    }
+);
+
+// How the convolution_border kernel reads pixels outside the image
+enum BorderMode
+{
+    BORDER_CLAMP,       // nearest edge pixel
+    BORDER_MIRROR,      // reflected about the edge pixel: -1 is 1, n is n-2
+    BORDER_WRAP,        // periodic: -1 is n-1
+};
+
+// Same as border_index() in the kernel source
+inline int border_index(int i, int n, BorderMode mode)
+{
+    switch (mode)
+    {
+    case BORDER_MIRROR:
+    {
+        if (n == 1)
+            return 0;
+        int period = 2*n - 2;
+        i = std::abs(i) % period;
+        return i < n ? i : period - i;
+    }
+    case BORDER_WRAP:
+        return (i % n + n) % n;
+    default:
+        return std::min(std::max(i, 0), n - 1);
+    }
+}
+
+// Same as border_index() on the host, `mode` is a BorderMode
+static const std::string border_index_kernel_source = KERNEL_SOURCE(
+    int border_index(int i, int n, int mode)
+    {
+        // BORDER_MIRROR
+        if (mode == 1)
+        {
+            if (n == 1)
+                return 0;
+            int period = 2*n - 2;
+            i = abs(i) % period;
+            return i < n ? i : period - i;
+        }
+        // BORDER_WRAP
+        if (mode == 2)
+            return (i % n + n) % n;
+        return clamp(i, 0, n - 1);
+    }
+);
+
+// Convolution split into two launches. convolution_interior is the
+// `convolution` kernel without any bounds check: it only runs the 16x16
+// groups whose tile and halo lie inside the image. convolution_border
+// covers the remaining frame, one pixel per work-item, and reads every
+// tap through border_index(). Both correlate like `convolution`.
+//
+// Prefixed with a typedef of pixel_t, float or float4, and the sum types
+// of convolution_precision_source(), see convolution_split_source().
+static const std::string convolution_split_kernel_source = KERNEL_SOURCE(
+    __kernel void convolution_interior(__global const pixel_t* imageIn,
+                                       __global pixel_t* imageOut,
+                                       __constant float* filter,
+                                       int rows,
+                                       int cols,
+                                       int filterWidth,
+                                       __local pixel_t* localImage,
+                                       int localHeight,
+                                       int localWidth)
+    {
+        int filterRadius = filterWidth / 2;
+
+        int groupStartCol = get_group_id(0)*get_local_size(0);
+        int groupStartRow = get_group_id(1)*get_local_size(1);
+        int localCol = get_local_id(0);
+        int localRow = get_local_id(1);
+
+        for (int i = localRow; i < localHeight; i += get_local_size(1))
+        {
+            int offset = (groupStartRow + i)*cols + groupStartCol;
+            for (int j = localCol; j < localWidth; j += get_local_size(0))
+                localImage[i*localWidth + j] = imageIn[offset + j];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        acc_t sum = (acc_t)(0.0f);
+        int filterIdx = 0;
+        for (int i = localRow; i < localRow+filterWidth; i++)
+        {
+            int offset = i*localWidth;
+            for (int j = localCol; j < localCol+filterWidth; j++)
+                sum += convert_acc(localImage[offset+j]) * (weight_t)filter[filterIdx++];
+        }
+
+        int globalRow = groupStartRow + localRow + filterRadius;
+        int globalCol = groupStartCol + localCol + filterRadius;
+        imageOut[globalRow*cols + globalCol] = convert_pixel(sum);
+    }
+
+    // Every pixel outside [x0, x1) x [y0, y1): the rows above, the pixels
+    // left and right of it, the rows below
+    __kernel void convolution_border(__global const pixel_t* imageIn,
+                                     __global pixel_t* imageOut,
+                                     __constant float* filter,
+                                     int rows,
+                                     int cols,
+                                     int filterWidth,
+                                     int x0,
+                                     int y0,
+                                     int x1,
+                                     int y1,
+                                     int mode)
+    {
+        int i = get_global_id(0);
+        int top = y0 * cols;
+        int sideWidth = cols - (x1 - x0);
+        int sides = (y1 - y0) * sideWidth;
+        int x;
+        int y;
+
+        if (i < top)
+        {
+            y = i / cols;
+            x = i % cols;
+        }
+        else if (i < top + sides)
+        {
+            y = y0 + (i - top) / sideWidth;
+            x = (i - top) % sideWidth;
+            if (x >= x0)
+                x += x1 - x0;
+        }
+        else
+        {
+            y = y1 + (i - top - sides) / cols;
+            x = (i - top - sides) % cols;
+            if (y >= rows)
+                return;
+        }
+
+        int filterRadius = filterWidth / 2;
+        acc_t sum = (acc_t)(0.0f);
+        for (int dy = 0; dy < filterWidth; dy++)
+        {
+            int offset = border_index(y - filterRadius + dy, rows, mode) * cols;
+            for (int dx = 0; dx < filterWidth; dx++)
+            {
+                int sx = border_index(x - filterRadius + dx, cols, mode);
+                sum += convert_acc(imageIn[offset + sx]) * (weight_t)filter[dy*filterWidth + dx];
+            }
+        }
+
+        imageOut[y*cols + x] = convert_pixel(sum);
+    }
+);
+
+// Interior kernel computing BLOCK_X x BLOCK_Y outputs per work-item,
+// side by side, for a filter of FILTER_WIDTH taps; all three are build
+// options, see convolution_blocked_options(). The item walks the input
+// rows of its block once, keeping one row segment in registers and adding
+// it to every output row whose filter reaches it, so it reads
+// (BLOCK_Y + FILTER_WIDTH - 1) * (BLOCK_X + FILTER_WIDTH - 1) local
+// values instead of FILTER_WIDTH^2 per output. Same arguments as
+// convolution_interior, `filterWidth` must equal FILTER_WIDTH.
+static const std::string convolution_blocked_kernel_source = KERNEL_SOURCE(
+    __kernel void convolution_blocked(__global const pixel_t* imageIn,
+                                      __global pixel_t* imageOut,
+                                      __constant float* filter,
+                                      int rows,
+                                      int cols,
+                                      int filterWidth,
+                                      __local pixel_t* localImage,
+                                      int localHeight,
+                                      int localWidth)
+    {
+        int groupStartCol = get_group_id(0)*get_local_size(0)*BLOCK_X;
+        int groupStartRow = get_group_id(1)*get_local_size(1)*BLOCK_Y;
+        int localCol = get_local_id(0);
+        int localRow = get_local_id(1);
+
+        for (int i = localRow; i < localHeight; i += get_local_size(1))
+        {
+            int offset = (groupStartRow + i)*cols + groupStartCol;
+            for (int j = localCol; j < localWidth; j += get_local_size(0))
+                localImage[i*localWidth + j] = imageIn[offset + j];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        int blockCol = localCol * BLOCK_X;
+        int blockRow = localRow * BLOCK_Y;
+
+        pixel_t sum[BLOCK_Y][BLOCK_X];
+        for (int m = 0; m < BLOCK_Y; m++)
+            for (int n = 0; n < BLOCK_X; n++)
+                sum[m][n] = (pixel_t)(0.0f);
+
+        for (int i = 0; i < BLOCK_Y + FILTER_WIDTH - 1; i++)
+        {
+            pixel_t window[BLOCK_X + FILTER_WIDTH - 1];
+            int offset = (blockRow + i)*localWidth + blockCol;
+            for (int j = 0; j < BLOCK_X + FILTER_WIDTH - 1; j++)
+                window[j] = localImage[offset + j];
+
+            // Bounds known at compile time once unrolled
+            for (int m = 0; m < BLOCK_Y; m++)
+            {
+                int dy = i - m;
+                if (dy < 0 || dy >= FILTER_WIDTH)
+                    continue;
+
+                for (int n = 0; n < BLOCK_X; n++)
+                    for (int dx = 0; dx < FILTER_WIDTH; dx++)
+                        sum[m][n] += window[n + dx] * filter[dy*FILTER_WIDTH + dx];
+            }
+        }
+
+        int filterRadius = FILTER_WIDTH / 2;
+        for (int m = 0; m < BLOCK_Y; m++)
+        {
+            int offset = (groupStartRow + blockRow + m + filterRadius)*cols + groupStartCol + blockCol + filterRadius;
+            for (int n = 0; n < BLOCK_X; n++)
+                imageOut[offset + n] = sum[m][n];
+        }
+    }
+);
+
+// Single launch convolutions of every pixel, reading outside the image
+// through border_index(). convolution_tiled stages its group's tile in
+// local memory first, convolution_global reads every tap from global
+// memory and is the baseline it is compared with.
+//
+// The tile is sized from the filter radius, (16 + 2r) x (16 + 2r) pixels,
+// with rows `pitch` pixels apart. An odd pitch (convolution_tile_pitch())
+// puts the pixels of a tile column into different banks. The group loads
+// it cooperatively in row-major order, consecutive work-items reading
+// consecutive pixels, so that every load is coalesced and float4 pixels
+// are single 16 byte vector loads; only the loader handles the border.
+static const std::string convolution_tiled_kernel_source = KERNEL_SOURCE(
+    void load_tile(__global const pixel_t* imageIn,
+                   __local pixel_t* tile,
+                   int rows,
+                   int cols,
+                   int radius,
+                   int pitch,
+                   int mode)
+    {
+        int tileWidth = get_local_size(0) + 2*radius;
+        int tileHeight = get_local_size(1) + 2*radius;
+        int startCol = get_group_id(0)*get_local_size(0) - radius;
+        int startRow = get_group_id(1)*get_local_size(1) - radius;
+        int items = get_local_size(0)*get_local_size(1);
+
+        for (int i = get_local_id(1)*get_local_size(0) + get_local_id(0); i < tileWidth*tileHeight; i += items)
+        {
+            int row = i / tileWidth;
+            int col = i - row*tileWidth;
+            int y = border_index(startRow + row, rows, mode);
+            int x = border_index(startCol + col, cols, mode);
+            tile[row*pitch + col] = imageIn[y*cols + x];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    __kernel void convolution_tiled(__global const pixel_t* imageIn,
+                                    __global pixel_t* imageOut,
+                                    __constant float* filter,
+                                    int rows,
+                                    int cols,
+                                    int filterWidth,
+                                    __local pixel_t* tile,
+                                    int pitch,
+                                    int mode)
+    {
+        load_tile(imageIn, tile, rows, cols, filterWidth / 2, pitch, mode);
+
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        if (x >= cols || y >= rows)
+            return;
+
+        pixel_t sum = (pixel_t)(0.0f);
+        for (int dy = 0; dy < filterWidth; dy++)
+        {
+            int offset = (get_local_id(1) + dy)*pitch + get_local_id(0);
+            for (int dx = 0; dx < filterWidth; dx++)
+                sum += tile[offset + dx] * filter[dy*filterWidth + dx];
+        }
+
+        imageOut[y*cols + x] = sum;
+    }
+
+    __kernel void convolution_global(__global const pixel_t* imageIn,
+                                     __global pixel_t* imageOut,
+                                     __constant float* filter,
+                                     int rows,
+                                     int cols,
+                                     int filterWidth,
+                                     int mode)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        if (x >= cols || y >= rows)
+            return;
+
+        int filterRadius = filterWidth / 2;
+        pixel_t sum = (pixel_t)(0.0f);
+        for (int dy = 0; dy < filterWidth; dy++)
+        {
+            int offset = border_index(y - filterRadius + dy, rows, mode) * cols;
+            for (int dx = 0; dx < filterWidth; dx++)
+                sum += imageIn[offset + border_index(x - filterRadius + dx, cols, mode)] * filter[dy*filterWidth + dx];
+        }
+
+        imageOut[y*cols + x] = sum;
+    }
+);
+
+// Convolution for CPU devices: one work-item per `segment` pixels of a
+// row, no local memory and no barriers. The output segment is cleared and
+// then every tap adds its weighted, shifted input row to it, a contiguous
+// loop without branches over the columns whose taps lie inside the image
+// that the compiler vectorises. Only the first and last filterWidth / 2
+// columns of a row read through border_index().
+static const std::string convolution_rows_kernel_source = KERNEL_SOURCE(
+    __kernel void convolution_rows(__global const pixel_t* imageIn,
+                                   __global pixel_t* imageOut,
+                                   __constant float* filter,
+                                   int rows,
+                                   int cols,
+                                   int filterWidth,
+                                   int segment,
+                                   int mode)
+    {
+        int y = get_global_id(1);
+        int first = get_global_id(0) * segment;
+        int last = min(first + segment, cols);
+        if (y >= rows || first >= last)
+            return;
+
+        int filterRadius = filterWidth / 2;
+        int innerFirst = clamp(filterRadius, first, last);
+        int innerLast = clamp(cols - filterRadius, innerFirst, last);
+
+        __global pixel_t* out = imageOut + y*cols;
+        for (int x = first; x < last; x++)
+            out[x] = (pixel_t)(0.0f);
+
+        for (int dy = 0; dy < filterWidth; dy++)
+        {
+            __global const pixel_t* in = imageIn + border_index(y - filterRadius + dy, rows, mode)*cols;
+            for (int dx = 0; dx < filterWidth; dx++)
+            {
+                float weight = filter[dy*filterWidth + dx];
+                int shift = dx - filterRadius;
+
+                for (int x = first; x < innerFirst; x++)
+                    out[x] += weight * in[border_index(x + shift, cols, mode)];
+                for (int x = innerFirst; x < innerLast; x++)
+                    out[x] += weight * in[x + shift];
+                for (int x = innerLast; x < last; x++)
+                    out[x] += weight * in[border_index(x + shift, cols, mode)];
+            }
+        }
+    }
+);
+
+// Convolution of a stack of equally sized images in one launch, the third
+// dimension picks the image. Taps go through border_index() within their
+// own image, so images never bleed into each other. Prefixed with a
+// typedef of pixel_t, see convolution_batch_source().
+static const std::string convolution_batch_kernel_source = KERNEL_SOURCE(
+    __kernel void convolution_batch(__global const pixel_t* imagesIn,
+                                    __global pixel_t* imagesOut,
+                                    __constant float* filter,
+                                    int rows,
+                                    int cols,
+                                    int filterWidth,
+                                    int mode)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        if (x >= cols || y >= rows)
+            return;
+
+        size_t offset = (size_t)get_global_id(2) * rows * cols;
+        __global const pixel_t* in = imagesIn + offset;
+        int filterRadius = filterWidth / 2;
+
+        pixel_t sum = (pixel_t)(0.0f);
+        for (int dy = 0; dy < filterWidth; dy++)
+        {
+            int row = border_index(y - filterRadius + dy, rows, mode) * cols;
+            for (int dx = 0; dx < filterWidth; dx++)
+                sum += filter[dy*filterWidth + dx] * in[row + border_index(x - filterRadius + dx, cols, mode)];
+        }
+
+        imagesOut[offset + y*cols + x] = sum;
+    }
+);
+
+inline std::string convolution_batch_source(bool rgba)
+{
+    return std::string(rgba ? "typedef float4 pixel_t;\n" : "typedef float pixel_t;\n") +
+           border_index_kernel_source + convolution_batch_kernel_source;
+}
+
+// `count` images of width x height pixels stacked in each buffer
+inline void enqueue_convolution_batch(cl::CommandQueue& queue,
+                                      cl::Kernel& batchKernel,
+                                      cl::Buffer const& devInputImages,
+                                      cl::Buffer& devOutputImages,
+                                      cl::Buffer const& devFilter,
+                                      int width,
+                                      int height,
+                                      int count,
+                                      int filterWidth,
+                                      BorderMode mode = BORDER_CLAMP,
+                                      cl::Event* event = nullptr)
+{
+    batchKernel.setArg(0, devInputImages);
+    batchKernel.setArg(1, devOutputImages);
+    batchKernel.setArg(2, devFilter);
+    batchKernel.setArg(3, height);
+    batchKernel.setArg(4, width);
+    batchKernel.setArg(5, filterWidth);
+    batchKernel.setArg(6, int(mode));
+
+    queue.enqueueNDRangeKernel(batchKernel, cl::NullRange,
+                               cl::NDRange(roundUp(width, WGX), roundUp(height, WGY), count),
+                               cl::NDRange(WGX, WGY, 1), nullptr, event);
+}
+
+// Split, tiled and row kernels for single channel (`rgba` false) or
+// float4 images, with convolution_blocked if `blocked`. The split kernels
+// sum in half if built with convolution_precision_options(PRECISION_HALF).
+inline std::string convolution_split_source(bool rgba, bool blocked = false)
+{
+    return std::string(rgba ? "typedef float4 pixel_t;\n" : "typedef float pixel_t;\n") +
+           convolution_precision_source(rgba) + border_index_kernel_source + convolution_split_kernel_source + convolution_tiled_kernel_source +
+           convolution_rows_kernel_source + (blocked ? convolution_blocked_kernel_source : std::string());
+}
+
+// Row pitch in pixels of the convolution_tiled tile, odd
+inline int convolution_tile_pitch(int filterWidth)
+{
+    return (WGX + (filterWidth / 2) * 2) | 1;
+}
+
+// Convolves every pixel in one convolution_tiled launch
+inline void enqueue_convolution_tiled(cl::CommandQueue& queue,
+                                      cl::Kernel& tiled,
+                                      cl::Buffer const& devInputImage,
+                                      cl::Buffer& devOutputImage,
+                                      cl::Buffer const& devFilter,
+                                      int rows,
+                                      int cols,
+                                      int filterWidth,
+                                      BorderMode mode,
+                                      size_t pixelSize,
+                                      cl::Event* event = nullptr)
+{
+    int pitch = convolution_tile_pitch(filterWidth);
+    int tileHeight = WGY + (filterWidth / 2) * 2;
+
+    tiled.setArg(0, devInputImage);
+    tiled.setArg(1, devOutputImage);
+    tiled.setArg(2, devFilter);
+    tiled.setArg(3, rows);
+    tiled.setArg(4, cols);
+    tiled.setArg(5, filterWidth);
+    tiled.setArg(6, pitch * tileHeight * pixelSize, nullptr);
+    tiled.setArg(7, pitch);
+    tiled.setArg(8, int(mode));
+
+    queue.enqueueNDRangeKernel(tiled, cl::NullRange, cl::NDRange(roundUp(cols, WGX), roundUp(rows, WGY)),
+                               cl::NDRange(WGX, WGY), nullptr, event);
+}
+
+// Build options of a program with convolution_blocked
+inline std::string convolution_blocked_options(int blockX, int blockY, int filterWidth)
+{
+    return "-D BLOCK_X=" + std::to_string(blockX) + " -D BLOCK_Y=" + std::to_string(blockY) +
+           " -D FILTER_WIDTH=" + std::to_string(filterWidth);
+}
+
+// Local memory the interior kernel takes per group
+inline size_t convolution_split_local_bytes(int filterWidth, size_t pixelSize, int blockX = 1, int blockY = 1)
+{
+    int paddingPixels = (filterWidth / 2) * 2;
+    return (WGX*blockX + paddingPixels) * (WGY*blockY + paddingPixels) * pixelSize;
+}
+
+// Interior of a split convolution: the output pixels of whole groups,
+// each blockX x blockY pixels per work-item
+struct ConvolutionSplit
+{
+    int groupsX;
+    int groupsY;
+    int x0;             // first interior column
+    int y0;
+    int x1;             // one past the last
+    int y1;
+    size_t border;      // pixels left to convolution_border
+
+    ConvolutionSplit(int rows, int cols, int filterWidth, int blockX = 1, int blockY = 1)
+    {
+        int filterRadius = filterWidth / 2;
+        groupsX = std::max(0, cols - 2*filterRadius) / int(WGX*blockX);
+        groupsY = std::max(0, rows - 2*filterRadius) / int(WGY*blockY);
+        x0 = std::min(filterRadius, cols);
+        y0 = std::min(filterRadius, rows);
+        x1 = x0 + groupsX * int(WGX*blockX);
+        y1 = y0 + groupsY * int(WGY*blockY);
+        border = size_t(rows) * cols - size_t(x1 - x0) * (y1 - y0);
+    }
+};
+
+// Convolves every pixel of devInputImage, pixelSize bytes each: the
+// interior launch, then the border launch. Appends both events to
+// `events` if given. `interior` is convolution_interior or, with the
+// block size it was built for, convolution_blocked.
+inline void enqueue_convolution_split(cl::CommandQueue& queue,
+                                      cl::Kernel& interior,
+                                      cl::Kernel& border,
+                                      cl::Buffer const& devInputImage,
+                                      cl::Buffer& devOutputImage,
+                                      cl::Buffer const& devFilter,
+                                      int rows,
+                                      int cols,
+                                      int filterWidth,
+                                      BorderMode mode,
+                                      size_t pixelSize,
+                                      std::vector<cl::Event>* events = nullptr,
+                                      int blockX = 1,
+                                      int blockY = 1)
+{
+    ConvolutionSplit split(rows, cols, filterWidth, blockX, blockY);
+    int paddingPixels = (filterWidth / 2) * 2;
+    int localWidth = WGX*blockX + paddingPixels;
+    int localHeight = WGY*blockY + paddingPixels;
+    cl::Event event;
+
+    if (split.groupsX && split.groupsY)
+    {
+        interior.setArg(0, devInputImage);
+        interior.setArg(1, devOutputImage);
+        interior.setArg(2, devFilter);
+        interior.setArg(3, rows);
+        interior.setArg(4, cols);
+        interior.setArg(5, filterWidth);
+        interior.setArg(6, localWidth * localHeight * pixelSize, nullptr);
+        interior.setArg(7, localHeight);
+        interior.setArg(8, localWidth);
+
+        queue.enqueueNDRangeKernel(interior, cl::NullRange, cl::NDRange(split.groupsX * WGX, split.groupsY * WGY),
+                                   cl::NDRange(WGX, WGY), nullptr, events ? &event : nullptr);
+        if (events)
+            events->push_back(event);
+    }
+
+    if (split.border)
+    {
+        border.setArg(0, devInputImage);
+        border.setArg(1, devOutputImage);
+        border.setArg(2, devFilter);
+        border.setArg(3, rows);
+        border.setArg(4, cols);
+        border.setArg(5, filterWidth);
+        border.setArg(6, split.x0);
+        border.setArg(7, split.y0);
+        border.setArg(8, split.x1);
+        border.setArg(9, split.y1);
+        border.setArg(10, int(mode));
+
+        queue.enqueueNDRangeKernel(border, cl::NullRange, cl::NDRange(roundUp(unsigned(split.border), 64)), cl::NDRange(64),
+                                   nullptr, events ? &event : nullptr);
+        if (events)
+            events->push_back(event);
+    }
+}
+
+// Convolution of every pixel with the kernels suited to the device:
+// the split interior and border launches on GPUs, convolution_rows on
+// CPU runtimes, where barriers are expensive and local memory is only
+// more cache. Images are single channel or float4 (`rgba`).
+//
+// With PRECISION_HALF the split kernels sum in half on devices with
+// cl_khr_fp16 and in float elsewhere; convolution_rows, which sums in the
+// output image, always uses float.
+struct Convolution
+{
+    // Pixels per work-item of convolution_rows
+    static constexpr int RowSegment = 256;
+
+    Convolution(cl::Context const& context, bool rgba = false, Precision precision = PRECISION_FLOAT) :
+        context_ (context),
+        device_ (),
+        queue_ (),
+        program_ (),
+        interiorKernel_ (),
+        borderKernel_ (),
+        rowsKernel_ (),
+        pixelSize_ ((rgba ? 4 : 1) * sizeof(float)),
+        precision_ (precision),
+        rows_ (false)
+    {
+        auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+        if (devices.empty())
+            throw cl::Error(CL_DEVICE_NOT_FOUND, "Convolution");
+
+        device_ = devices.front();
+        queue_ = cl::CommandQueue(context_, device_);
+        rows_ = (device_.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU) != 0;
+        precision_ = convolution_precision(device_, precision);
+
+        program_ = cl::Program(context_, convolution_split_source(rgba));
+        try
+        {
+            program_.build({device_}, convolution_precision_options(precision_).c_str());
+        }
+        catch (cl::Error const&)
+        {
+            std::cerr << "BUILD INFO: " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+            throw;
+        }
+
+        interiorKernel_ = cl::Kernel(program_, "convolution_interior");
+        borderKernel_ = cl::Kernel(program_, "convolution_border");
+        rowsKernel_ = cl::Kernel(program_, "convolution_rows");
+    }
+
+    // Appends the events of all launches to `events` if given
+    void enqueue(cl::CommandQueue& queue,
+                 cl::Buffer const& devInputImage,
+                 cl::Buffer& devOutputImage,
+                 cl::Buffer const& devFilter,
+                 int width,
+                 int height,
+                 int filterWidth,
+                 BorderMode mode = BORDER_CLAMP,
+                 std::vector<cl::Event>* events = nullptr)
+    {
+        if (!rows_)
+        {
+            enqueue_convolution_split(queue, interiorKernel_, borderKernel_, devInputImage, devOutputImage, devFilter,
+                                      height, width, filterWidth, mode, pixelSize_, events);
+            return;
+        }
+
+        rowsKernel_.setArg(0, devInputImage);
+        rowsKernel_.setArg(1, devOutputImage);
+        rowsKernel_.setArg(2, devFilter);
+        rowsKernel_.setArg(3, height);
+        rowsKernel_.setArg(4, width);
+        rowsKernel_.setArg(5, filterWidth);
+        rowsKernel_.setArg(6, int(RowSegment));
+        rowsKernel_.setArg(7, int(mode));
+
+        // Any group size, the kernel does not share anything
+        cl::Event event;
+        queue.enqueueNDRangeKernel(rowsKernel_, cl::NullRange,
+                                   cl::NDRange((width + RowSegment - 1) / RowSegment, height), cl::NullRange,
+                                   nullptr, events ? &event : nullptr);
+        if (events)
+            events->push_back(event);
+    }
+
+    cl::CommandQueue queue() const
+    {
+        return queue_;
+    }
+
+    // convolution_rows, chosen for CPU devices
+    void setRows(bool rows)
+    {
+        rows_ = rows;
+    }
+
+    bool rows() const
+    {
+        return rows_;
+    }
+
+    // Precision enqueue() sums in
+    Precision precision() const
+    {
+        return rows_ ? PRECISION_FLOAT : precision_;
+    }
+
+private:
+    cl::Context context_;
+    cl::Device device_;
+    cl::CommandQueue queue_;
+    cl::Program program_;
+    cl::Kernel interiorKernel_;
+    cl::Kernel borderKernel_;
+    cl::Kernel rowsKernel_;
+    size_t pixelSize_;
+    Precision precision_;   // of the split kernels
+    bool rows_;
+};
+
+#endif // CONVOLUTION_H
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "filter-codegen.h"
+
+// `name` shifted by `offset`, e.g. "x - 2"
+static std::string codegen_offset(char const* name, int offset)
+{
+    return std::string(name) + (offset < 0 ? " - " : " + ") + std::to_string(std::abs(offset));
+}
+
+std::vector<FilterTerm> filter_terms(std::vector<float> const& filter, int filterWidth)
+{
+    if (filterWidth < 1 || !(filterWidth & 1) || filter.size() != size_t(filterWidth) * filterWidth)
+        throw cl::Error(CL_INVALID_VALUE, "filter_terms");
+
+    int filterRadius = filterWidth / 2;
+    std::vector<FilterTerm> terms;
+    for (int dy = 0; dy < filterWidth; dy++)
+    {
+        for (int dx = 0; dx < filterWidth; dx++)
+        {
+            float weight = filter[dy*filterWidth + dx];
+            if (weight == 0.0f)
+                continue;
+
+            auto term = std::find_if(terms.begin(), terms.end(), [weight](FilterTerm const& term)
+            {
+                return term.weight == weight;
+            });
+            if (term == terms.end())
+                term = terms.insert(terms.end(), FilterTerm {weight, {}});
+            term->taps.emplace_back(dx - filterRadius, dy - filterRadius);
+        }
+    }
+
+    return terms;
+}
+
+std::string convolution_generated_source(std::vector<float> const& filter, int filterWidth, BorderMode mode,
+                                         bool rgba)
+{
+    auto terms = filter_terms(filter, filterWidth);
+    int filterRadius = filterWidth / 2;
+
+    // Offsets some tap reads, so unused rows and columns cost nothing
+    std::vector<char> rows(filterWidth, 0);
+    std::vector<char> cols(filterWidth, 0);
+    for (auto const& term : terms)
+    {
+        for (auto const& tap : term.taps)
+        {
+            cols[tap.first + filterRadius] = 1;
+            rows[tap.second + filterRadius] = 1;
+        }
+    }
+
+    std::ostringstream source;
+    source << (rgba ? "typedef float4 pixel_t;\n" : "typedef float pixel_t;\n")
+           << border_index_kernel_source << "\n"
+              "\n"
+              "__kernel void convolution_generated(__global const pixel_t* imageIn,\n"
+              "                                    __global pixel_t* imageOut,\n"
+              "                                    int rows,\n"
+              "                                    int cols)\n"
+              "{\n"
+              "    int x = get_global_id(0);\n"
+              "    int y = get_global_id(1);\n"
+              "    if (x >= cols || y >= rows)\n"
+              "        return;\n"
+              "\n";
+
+    for (int i = 0; i < filterWidth; i++)
+    {
+        if (rows[i])
+            source << "    int row" << i << " = border_index(" << codegen_offset("y", i - filterRadius) << ", rows, " << int(mode)
+                   << ") * cols;\n";
+    }
+    for (int i = 0; i < filterWidth; i++)
+    {
+        if (cols[i])
+            source << "    int col" << i << " = border_index(" << codegen_offset("x", i - filterRadius) << ", cols, " << int(mode)
+                   << ");\n";
+    }
+
+    source << "\n"
+              "    pixel_t sum = (pixel_t)(0.0f);\n";
+    for (auto const& term : terms)
+    {
+        std::ostringstream taps;
+        for (size_t i = 0; i < term.taps.size(); i++)
+        {
+            taps << (i ? " + " : "") << "imageIn[row" << term.taps[i].second + filterRadius
+                 << " + col" << term.taps[i].first + filterRadius << "]";
+        }
+
+        if (term.weight == 1.0f)
+            source << "    sum += " << taps.str() << ";\n";
+        else if (term.weight == -1.0f)
+            source << "    sum -= " << taps.str() << ";\n";
+        else
+            source << "    sum += " << kernel_literal(term.weight) << " * (" << taps.str() << ");\n";
+    }
+
+    source << "\n"
+              "    imageOut[y*cols + x] = sum;\n"
+              "}\n";
+    return source.str();
+}
+
+void convolution_generated_host(std::vector<FilterTerm> const& terms, float const* in, float* out, int width,
+                                int height, int channels, BorderMode mode)
+{
+    size_t rowSize = size_t(width) * channels;
+    std::vector<float> group(rowSize);
+
+    for (int y = 0; y < height; y++)
+    {
+        float* outRow = out + y * rowSize;
+        std::fill(outRow, outRow + rowSize, 0.0f);
+
+        for (auto const& term : terms)
+        {
+            std::fill(group.begin(), group.end(), 0.0f);
+            for (auto const& tap : term.taps)
+            {
+                int dx = tap.first;
+                float const* inRow = in + border_index(y + tap.second, height, mode) * rowSize;
+
+                // Columns whose tap lies inside the row
+                int first = std::min(std::max(-dx, 0), width);
+                int last = std::max(std::min(width - dx, width), first);
+
+                for (int x = 0; x < first; x++)
+                {
+                    for (int c = 0; c < channels; c++)
+                        group[x*channels + c] += inRow[border_index(x + dx, width, mode)*channels + c];
+                }
+                for (size_t i = size_t(first) * channels; i < size_t(last) * channels; i++)
+                    group[i] += inRow[i + dx * channels];
+                for (int x = last; x < width; x++)
+                {
+                    for (int c = 0; c < channels; c++)
+                        group[x*channels + c] += inRow[border_index(x + dx, width, mode)*channels + c];
+                }
+            }
+
+            // The kernel skips multiplies by one, which are exact anyway
+            for (size_t i = 0; i < rowSize; i++)
+                outRow[i] += term.weight * group[i];
+        }
+    }
+}
+
+GeneratedConvolution::GeneratedConvolution(cl::Context const& context, bool rgba) :
+    context_ (context),
+    device_ (),
+    queue_ (),
+    rgba_ (rgba),
+    programs_ (),
+    kernels_ ()
+{
+    auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+    if (devices.empty())
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "GeneratedConvolution");
+
+    device_ = devices.front();
+    queue_ = cl::CommandQueue(context_, device_);
+    programs_ = ProgramCache::forDevice(context_, device_);
+}
+
+void GeneratedConvolution::enqueue(cl::CommandQueue& queue,
+                                   cl::Buffer const& devInputImage,
+                                   cl::Buffer& devOutputImage,
+                                   int width,
+                                   int height,
+                                   std::vector<float> const& filter,
+                                   int filterWidth,
+                                   BorderMode mode,
+                                   cl::Event* event)
+{
+    auto source = convolution_generated_source(filter, filterWidth, mode, rgba_);
+    auto found = kernels_.find(source);
+    if (found == kernels_.end())
+        found = kernels_.emplace(source, cl::Kernel(programs_->program(source), "convolution_generated")).first;
+
+    auto& generated = found->second;
+    generated.setArg(0, devInputImage);
+    generated.setArg(1, devOutputImage);
+    generated.setArg(2, height);
+    generated.setArg(3, width);
+
+    queue.enqueueNDRangeKernel(generated, cl::NullRange, cl::NDRange(roundUp(width, WGX), roundUp(height, WGY)),
+                               cl::NDRange(WGX, WGY), nullptr, event);
+}
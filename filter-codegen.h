@@ -0,0 +1,78 @@
+#ifndef FILTER_CODEGEN_H
+#define FILTER_CODEGEN_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "opencl.h"
+#include "convolution.h"
+#include "program-cache.h"
+
+// One distinct nonzero weight of a filter and the taps it multiplies, as
+// (dx, dy) offsets from the centre. Taps of equal weight, among them the
+// mirrored taps of a symmetric filter, are added before the one multiply.
+struct FilterTerm
+{
+    float weight;
+    std::vector<std::pair<int, int>> taps;
+};
+
+// Terms of a filterWidth x filterWidth filter (odd width, correlated like
+// the `convolution` kernel) in row-major order of their first tap. Zero
+// taps are dropped.
+std::vector<FilterTerm> filter_terms(std::vector<float> const& filter, int filterWidth);
+
+// OpenCL C of `convolution_generated(imageIn, imageOut, rows, cols)` for
+// `filter`: one pixel per work-item over the whole image, the weights and
+// `mode` as literals, the rows and columns of the taps resolved through
+// border_index() once per pixel. Single channel or float4 (`rgba`).
+std::string convolution_generated_source(std::vector<float> const& filter, int filterWidth, BorderMode mode,
+                                         bool rgba);
+
+// The same terms on the host, summed in the same order: a row at a time,
+// every tap of a term a contiguous loop over the row that the compiler
+// vectorises, then one multiply-add of the sum per term.
+void convolution_generated_host(std::vector<FilterTerm> const& terms, float const* in, float* out, int width,
+                                int height, int channels, BorderMode mode);
+
+// Convolution with kernels generated for each filter. A program is built
+// the first time its filter, mode and layout are used on the device and
+// kept in the ProgramCache that StencilChain uses too.
+struct GeneratedConvolution
+{
+    GeneratedConvolution(cl::Context const& context, bool rgba = false);
+
+    void enqueue(cl::CommandQueue& queue,
+                 cl::Buffer const& devInputImage,
+                 cl::Buffer& devOutputImage,
+                 int width,
+                 int height,
+                 std::vector<float> const& filter,
+                 int filterWidth,
+                 BorderMode mode = BORDER_CLAMP,
+                 cl::Event* event = nullptr);
+
+    // Programs built so far on the device, by any engine
+    size_t programs() const
+    {
+        return programs_->size();
+    }
+
+    cl::CommandQueue queue() const
+    {
+        return queue_;
+    }
+
+private:
+    cl::Context context_;
+    cl::Device device_;
+    cl::CommandQueue queue_;
+    bool rgba_;
+    std::shared_ptr<ProgramCache> programs_;     // of device_
+    std::map<std::string, cl::Kernel> kernels_;  // this engine's, by source
+};
+
+#endif // FILTER_CODEGEN_H
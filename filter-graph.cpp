@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <iostream>
+
+#include "convolution.h"
+#include "filter-graph.h"
+
+static constexpr unsigned PixelSize = 16;
+
+static const std::string graph_kernel_source = KERNEL_SOURCE(
+    __kernel void mix_images(__global const float4* a,
+                             __global const float4* b,
+                             __global float4* imageOut,
+                             float weight,
+                             int pixels)
+    {
+        int i = get_global_id(0);
+        if (i < pixels)
+            imageOut[i] = mix(a[i], b[i], weight);
+    }
+);
+
+FilterGraph::FilterGraph(cl::Context const& context, int queues) :
+    context_ (context),
+    device_ (),
+    queues_ (),
+    program_ (),
+    mixKernel_ (),
+    nodes_ (),
+    inputs_ (0),
+    outputs_ (0),
+    planned_ (false),
+    order_ (),
+    queueOf_ (),
+    slotOf_ (),
+    slots_ (0),
+    pool_ (),
+    poolPixels_ (0)
+{
+    if (queues < 1)
+        throw cl::Error(CL_INVALID_VALUE, "FilterGraph");
+
+    auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+    if (devices.empty())
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "FilterGraph");
+
+    device_ = devices.front();
+    for (int i = 0; i < queues; i++)
+        queues_.push_back(cl::CommandQueue(context_, device_));
+
+    program_ = cl::Program(context_, graph_kernel_source);
+    try
+    {
+        program_.build({device_});
+    }
+    catch (cl::Error const&)
+    {
+        std::cerr << "BUILD INFO: " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+        throw;
+    }
+
+    mixKernel_ = cl::Kernel(program_, "mix_images");
+}
+
+int FilterGraph::input()
+{
+    nodes_.push_back(Node {FilterStage(), {}, inputs_++, -1});
+    planned_ = false;
+    return int(nodes_.size()) - 1;
+}
+
+int FilterGraph::add(FilterStage stage, std::vector<int> const& inputs)
+{
+    if (!stage)
+        throw cl::Error(CL_INVALID_VALUE, "FilterGraph::add");
+    for (auto node : inputs)
+    {
+        if (node < 0 || node >= int(nodes_.size()))
+            throw cl::Error(CL_INVALID_VALUE, "FilterGraph::add");
+    }
+
+    nodes_.push_back(Node {stage, inputs, -1, -1});
+    planned_ = false;
+    return int(nodes_.size()) - 1;
+}
+
+int FilterGraph::mix(int a, int b, float weight)
+{
+    cl::Kernel kernel = mixKernel_;
+
+    return add([kernel, weight](cl::CommandQueue& queue,
+                                std::vector<cl::Buffer> const& inputs,
+                                cl::Buffer& output,
+                                int width,
+                                int height) mutable
+    {
+        int pixels = width * height;
+        kernel.setArg(0, inputs[0]);
+        kernel.setArg(1, inputs[1]);
+        kernel.setArg(2, output);
+        kernel.setArg(3, weight);
+        kernel.setArg(4, pixels);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(roundUp(pixels, 256)), cl::NDRange(256));
+    }, {a, b});
+}
+
+void FilterGraph::output(int node)
+{
+    if (node < 0 || node >= int(nodes_.size()) || !nodes_[node].stage || nodes_[node].output >= 0)
+        throw cl::Error(CL_INVALID_VALUE, "FilterGraph::output");
+
+    nodes_[node].output = outputs_++;
+    planned_ = false;
+}
+
+int FilterGraph::intermediates()
+{
+    plan();
+    return int(std::count_if(order_.begin(), order_.end(), [this](int node)
+    {
+        return nodes_[node].output < 0;
+    }));
+}
+
+int FilterGraph::buffers()
+{
+    plan();
+    return slots_;
+}
+
+void FilterGraph::plan()
+{
+    if (planned_)
+        return;
+
+    int count = int(nodes_.size());
+
+    // Stages an output depends on. Inputs of a node always have lower
+    // indices, so one pass from the back reaches all of them.
+    std::vector<char> live(count, 0);
+    for (int node = count - 1; node >= 0; node--)
+    {
+        live[node] |= nodes_[node].output >= 0;
+        if (live[node])
+        {
+            for (auto input : nodes_[node].inputs)
+                live[input] = 1;
+        }
+    }
+
+    std::vector<std::vector<char>> ancestor(count, std::vector<char>(count, 0));
+    std::vector<std::vector<int>> readers(count);
+    std::vector<int> pending(count, 0);
+    for (int node = 0; node < count; node++)
+    {
+        for (auto input : nodes_[node].inputs)
+        {
+            ancestor[node][input] = 1;
+            for (int i = 0; i < count; i++)
+                ancestor[node][i] |= ancestor[input][i];
+
+            if (live[node])
+                readers[input].push_back(node);
+            if (nodes_[input].stage)
+                pending[node]++;
+        }
+    }
+
+    // Kahn's algorithm with a stack: the stages an image unblocks run
+    // right after it, the lowest index first
+    order_.clear();
+    std::vector<int> ready;
+    for (int node = count - 1; node >= 0; node--)
+    {
+        if (live[node] && nodes_[node].stage && !pending[node])
+            ready.push_back(node);
+    }
+    while (!ready.empty())
+    {
+        int node = ready.back();
+        ready.pop_back();
+        order_.push_back(node);
+
+        for (auto reader = readers[node].rbegin(); reader != readers[node].rend(); ++reader)
+        {
+            if (!--pending[*reader])
+                ready.push_back(*reader);
+        }
+    }
+
+    std::vector<int> position(count, -1);
+    for (size_t i = 0; i < order_.size(); i++)
+        position[order_[i]] = int(i);
+
+    queueOf_.assign(count, 0);
+    std::vector<char> continued(count, 0);
+    int next = 0;
+    for (auto node : order_)
+    {
+        auto const& inputs = nodes_[node].inputs;
+        if (!inputs.empty() && nodes_[inputs.front()].stage && !continued[inputs.front()])
+        {
+            queueOf_[node] = queueOf_[inputs.front()];
+            continued[inputs.front()] = 1;
+        }
+        else
+            queueOf_[node] = next++ % int(queues_.size());
+    }
+
+    // Greedy buffer assignment in schedule order. Readers of an image
+    // depend on its writer, so checking them covers both.
+    slotOf_.assign(count, -1);
+    std::vector<int> holder;
+    for (size_t i = 0; i < order_.size(); i++)
+    {
+        int node = order_[i];
+        if (nodes_[node].output >= 0)
+            continue;
+
+        int slot = 0;
+        for (; slot < int(holder.size()); slot++)
+        {
+            auto const& previous = readers[holder[slot]];
+            bool done = std::all_of(previous.begin(), previous.end(), [&](int reader)
+            {
+                return position[reader] < int(i) &&
+                       (queueOf_[reader] == queueOf_[node] || ancestor[node][reader]);
+            });
+            if (done)
+                break;
+        }
+
+        if (slot == int(holder.size()))
+            holder.push_back(node);
+        else
+            holder[slot] = node;
+        slotOf_[node] = slot;
+    }
+
+    slots_ = int(holder.size());
+    planned_ = true;
+}
+
+void FilterGraph::enqueue(cl::CommandQueue& queue,
+                          std::vector<cl::Buffer> const& inputs,
+                          std::vector<cl::Buffer> const& outputs,
+                          int width,
+                          int height,
+                          cl::Event* event)
+{
+    if (int(inputs.size()) != inputs_ || int(outputs.size()) != outputs_)
+        throw cl::Error(CL_INVALID_VALUE, "FilterGraph::enqueue");
+
+    plan();
+    queues_.front() = queue;
+
+    size_t pixels = size_t(width) * height;
+    if (pixels > poolPixels_)
+    {
+        pool_.clear();
+        poolPixels_ = pixels;
+    }
+    while (int(pool_.size()) < slots_)
+        pool_.push_back(cl::Buffer(context_, CL_MEM_READ_WRITE, poolPixels_ * PixelSize));
+
+    std::vector<cl::Buffer> images(nodes_.size());
+    for (size_t node = 0; node < nodes_.size(); node++)
+    {
+        if (nodes_[node].input >= 0)
+            images[node] = inputs[nodes_[node].input];
+        else if (nodes_[node].output >= 0)
+            images[node] = outputs[nodes_[node].output];
+        else if (slotOf_[node] >= 0)
+            images[node] = pool_[slotOf_[node]];
+    }
+
+    // The other queues start after the work already on the caller's
+    cl::Event start;
+    queue.enqueueMarkerWithWaitList(nullptr, &start);
+
+    std::vector<char> used(queues_.size(), 0);
+    std::vector<cl::Event> last(queues_.size());
+    std::vector<cl::Event> done(nodes_.size());
+    used.front() = 1;
+
+    for (auto node : order_)
+    {
+        int index = queueOf_[node];
+        auto& stageQueue = queues_[index];
+
+        std::vector<cl::Event> wait;
+        if (!used[index])
+            wait.push_back(start);
+        used[index] = 1;
+        for (auto input : nodes_[node].inputs)
+        {
+            if (nodes_[input].stage && queueOf_[input] != index)
+                wait.push_back(done[input]);
+        }
+        if (!wait.empty())
+            stageQueue.enqueueBarrierWithWaitList(&wait);
+
+        std::vector<cl::Buffer> stageInputs;
+        for (auto input : nodes_[node].inputs)
+            stageInputs.push_back(images[input]);
+
+        nodes_[node].stage(stageQueue, stageInputs, images[node], width, height);
+        stageQueue.enqueueMarkerWithWaitList(nullptr, &done[node]);
+        last[index] = done[node];
+    }
+
+    std::vector<cl::Event> branches;
+    for (size_t i = 1; i < queues_.size(); i++)
+    {
+        if (used[i])
+            branches.push_back(last[i]);
+    }
+    if (!branches.empty())
+        queue.enqueueBarrierWithWaitList(&branches);
+    if (event)
+        queue.enqueueMarkerWithWaitList(nullptr, event);
+}
@@ -0,0 +1,103 @@
+#ifndef FILTER_GRAPH_H
+#define FILTER_GRAPH_H
+
+#include <functional>
+#include <vector>
+
+#include "opencl.h"
+
+// Enqueues one filter on `queue` (in order), reading `inputs` and writing
+// `output`, all width x height float4 (RGBA) images. The graph orders the
+// queues around the call, the stage only has to stay on `queue`.
+typedef std::function<void(cl::CommandQueue& queue,
+                           std::vector<cl::Buffer> const& inputs,
+                           cl::Buffer& output,
+                           int width,
+                           int height)> FilterStage;
+
+// Directed acyclic graph of filter stages run as one effect.
+//
+// Nodes are the images passed to enqueue(), added with input(), and the
+// outputs of stages, added with add() on nodes that already exist, so the
+// graph is acyclic by construction. Stages nothing marked with output()
+// depends on are never run.
+//
+// enqueue() schedules the stages in topological order, depth first so
+// that chains finish before the next branch starts, and runs every branch
+// on its own queue: a stage continues on the queue of its first input
+// unless another stage already did, otherwise it takes the next queue in
+// turn. Stages wait for inputs computed on other queues through events.
+//
+// Intermediate images share buffers from a pool kept between calls. A
+// stage reuses the buffer of an image whose last reader is scheduled
+// before it, provided that reader and the image's writer are on its
+// own queue or among its ancestors, so that the lifetimes cannot overlap
+// on the device either. Outputs are written to the caller's buffers.
+struct FilterGraph
+{
+    // `queues` includes the queue passed to enqueue()
+    FilterGraph(cl::Context const& context, int queues = 2);
+
+    // Next image of the `inputs` of enqueue()
+    int input();
+
+    int add(FilterStage stage, std::vector<int> const& inputs);
+
+    // (1 - weight) * a + weight * b
+    int mix(int a, int b, float weight);
+
+    // Next image of the `outputs` of enqueue(). Throws for inputs and for
+    // nodes already marked.
+    void output(int node);
+
+    // Starts after the work already on `queue`; `event` completes, and
+    // `queue` continues, once every stage has.
+    void enqueue(cl::CommandQueue& queue,
+                 std::vector<cl::Buffer> const& inputs,
+                 std::vector<cl::Buffer> const& outputs,
+                 int width,
+                 int height,
+                 cl::Event* event = nullptr);
+
+    // Intermediate images of the stages that run, one buffer each
+    // without reuse
+    int intermediates();
+
+    // Pooled buffers enqueue() takes for them
+    int buffers();
+
+    cl::CommandQueue queue() const
+    {
+        return queues_.front();
+    }
+
+private:
+    struct Node
+    {
+        FilterStage stage;          // empty for inputs
+        std::vector<int> inputs;
+        int input;                  // index into enqueue() inputs or -1
+        int output;                 // index into enqueue() outputs or -1
+    };
+
+    // Fills order_, queueOf_ and slotOf_ once after the graph changed
+    void plan();
+
+    cl::Context context_;
+    cl::Device device_;
+    std::vector<cl::CommandQueue> queues_;  // [0] is replaced by the caller's
+    cl::Program program_;
+    cl::Kernel mixKernel_;
+    std::vector<Node> nodes_;
+    int inputs_;
+    int outputs_;
+    bool planned_;
+    std::vector<int> order_;                // stages to run
+    std::vector<int> queueOf_;              // by node
+    std::vector<int> slotOf_;               // pool buffer by node, or -1
+    int slots_;
+    std::vector<cl::Buffer> pool_;
+    size_t poolPixels_;
+};
+
+#endif // FILTER_GRAPH_H
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "fixed-point.h"
+
+static const std::string fixed_point_kernel_source = border_index_kernel_source + KERNEL_SOURCE(
+    // 8-bit pixels times 8-bit weights summed in 16-bit lanes, which the
+    // host guarantees cannot overflow; rounded, shifted and saturated
+    __kernel void convolution_fixed(__global const uchar4* imageIn,
+                                    __global uchar4* imageOut,
+                                    __constant char* filter,
+                                    int rows,
+                                    int cols,
+                                    int filterWidth,
+                                    int shift,
+                                    int mode)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        if (x >= cols || y >= rows)
+            return;
+
+        int filterRadius = filterWidth / 2;
+        short4 sum = (short4)(0);
+        for (int dy = 0; dy < filterWidth; dy++)
+        {
+            int offset = border_index(y - filterRadius + dy, rows, mode) * cols;
+            for (int dx = 0; dx < filterWidth; dx++)
+            {
+                short4 pixel = convert_short4(imageIn[offset + border_index(x - filterRadius + dx, cols, mode)]);
+                sum += pixel * (short)filter[dy*filterWidth + dx];
+            }
+        }
+
+        short4 rounding = (short4)(shift > 0 ? 1 << (shift - 1) : 0);
+        imageOut[y*cols + x] = convert_uchar4_sat((sum + rounding) >> (short4)(shift));
+    }
+
+    // a + (b - a) * weight / 128, weight 0..128, in 16-bit lanes
+    uchar4 lerp_fixed(uchar4 a, uchar4 b, short weight)
+    {
+        short4 blend = convert_short4(a) * (short)(128 - weight) + convert_short4(b) * weight;
+        return convert_uchar4((blend + (short4)(64)) >> (short4)(7));
+    }
+
+    // Same addressing as sample_bilinear(), weights rounded to 7 bits
+    uchar4 sample_fixed(__global const uchar4* image, int width, int height, float x, float y)
+    {
+        float fx = floor(x);
+        float fy = floor(y);
+        short ax = (short)round((x - fx) * 128.0f);
+        short ay = (short)round((y - fy) * 128.0f);
+
+        int x0 = clamp((int)fx, 0, width - 1);
+        int y0 = clamp((int)fy, 0, height - 1);
+        int x1 = clamp((int)fx + 1, 0, width - 1);
+        int y1 = clamp((int)fy + 1, 0, height - 1);
+
+        uchar4 top = lerp_fixed(image[y0*width + x0], image[y0*width + x1], ax);
+        uchar4 bottom = lerp_fixed(image[y1*width + x0], image[y1*width + x1], ax);
+        return lerp_fixed(top, bottom, ay);
+    }
+
+    // arc_mean() of the rotational blur at full resolution; the sum of
+    // the samples needs 32 bits
+    __kernel void rotational_blur_fixed(__global const uchar4* imageIn,
+                                        __global uchar4* imageOut,
+                                        int width,
+                                        int height,
+                                        float angle,
+                                        float density,
+                                        int maxSamples)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        if (x >= width || y >= height)
+            return;
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        int samples = max(1, (int)ceil(radius * angle * density));
+        samples = maxSamples > 0 ? min(samples, maxSamples) : samples;
+
+        float step = angle / samples;
+        float start = theta - 0.5f * angle + 0.5f * step;
+
+        uint4 sum = (uint4)(0);
+        for (int i = 0; i < samples; i++)
+        {
+            float t = start + i * step;
+            float sx = (cx + radius * cos(t) + 0.5f) - 0.5f;
+            float sy = (cy + radius * sin(t) + 0.5f) - 0.5f;
+            sum += convert_uint4(sample_fixed(imageIn, width, height, sx, sy));
+        }
+
+        imageOut[y*width + x] = convert_uchar4((sum + (uint4)(samples / 2)) / (uint4)(samples));
+    }
+);
+
+FixedPointFilter quantize_filter(std::vector<float> const& filter, int filterWidth)
+{
+    if (filterWidth < 1 || filter.size() != size_t(filterWidth) * filterWidth)
+        throw cl::Error(CL_INVALID_VALUE, "quantize_filter");
+
+    double sum = 0.0;
+    for (auto weight : filter)
+        sum += weight;
+
+    // Any shift beyond 14 leaves no room for 8-bit pixels in 16 bits
+    for (int shift = 14; shift >= 0; shift--)
+    {
+        double scale = std::ldexp(1.0, shift);
+        std::vector<long> values;
+        long total = 0;
+        for (auto weight : filter)
+        {
+            values.push_back(std::lround(weight * scale));
+            total += values.back();
+        }
+
+        // Rounding every weight on its own shifts the gain of the filter
+        // by up to half a step per weight; move the weights rounded
+        // furthest the other way by one step until it is back
+        long drift = std::lround(sum * scale) - total;
+        std::vector<size_t> order(filter.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        {
+            return filter[a] * scale - values[a] > filter[b] * scale - values[b];
+        });
+        for (long i = 0; i < std::abs(drift) && i < long(order.size()); i++)
+            values[drift > 0 ? order[i] : order[order.size() - 1 - i]] += drift > 0 ? 1 : -1;
+
+        FixedPointFilter fixed {filterWidth, shift, {}, 0.0};
+        long magnitude = 0;
+        bool fits = true;
+        for (size_t i = 0; i < filter.size(); i++)
+        {
+            fits &= std::abs(values[i]) <= 127;
+            magnitude += std::abs(values[i]);
+            fixed.weights.push_back(cl_char(values[i]));
+            fixed.bound += 255.0 * std::fabs(filter[i] - values[i] / scale);
+        }
+
+        long rounding = shift > 0 ? 1 << (shift - 1) : 0;
+        if (!fits || 255 * magnitude + rounding > 32767)
+            continue;
+
+        // Clamping to 0..255 only brings values closer together
+        if (shift > 0)
+            fixed.bound += 0.5;
+        return fixed;
+    }
+
+    throw cl::Error(CL_INVALID_VALUE, "quantize_filter");
+}
+
+FixedPointBlur::FixedPointBlur(cl::Context const& context) :
+    context_ (context),
+    device_ (),
+    queue_ (),
+    program_ (),
+    convolutionKernel_ (),
+    rotationalKernel_ (),
+    filter_ (),
+    filterSize_ (0)
+{
+    auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+    if (devices.empty())
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "FixedPointBlur");
+
+    device_ = devices.front();
+    queue_ = cl::CommandQueue(context_, device_);
+
+    program_ = cl::Program(context_, fixed_point_kernel_source);
+    try
+    {
+        program_.build({device_});
+    }
+    catch (cl::Error const&)
+    {
+        std::cerr << "BUILD INFO: " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+        throw;
+    }
+
+    convolutionKernel_ = cl::Kernel(program_, "convolution_fixed");
+    rotationalKernel_ = cl::Kernel(program_, "rotational_blur_fixed");
+}
+
+void FixedPointBlur::enqueueConvolution(cl::CommandQueue& queue,
+                                        cl::Buffer const& devInputImage,
+                                        cl::Buffer& devOutputImage,
+                                        int width,
+                                        int height,
+                                        FixedPointFilter const& filter,
+                                        BorderMode mode,
+                                        cl::Event* event)
+{
+    size_t size = filter.weights.size() * sizeof(cl_char);
+    if (size > filterSize_)
+    {
+        filter_ = cl::Buffer(context_, CL_MEM_READ_ONLY, size);
+        filterSize_ = size;
+    }
+    // Blocking, `filter` may be a temporary; at most 225 bytes
+    queue.enqueueWriteBuffer(filter_, CL_TRUE, 0, size, filter.weights.data());
+
+    convolutionKernel_.setArg(0, devInputImage);
+    convolutionKernel_.setArg(1, devOutputImage);
+    convolutionKernel_.setArg(2, filter_);
+    convolutionKernel_.setArg(3, height);
+    convolutionKernel_.setArg(4, width);
+    convolutionKernel_.setArg(5, filter.width);
+    convolutionKernel_.setArg(6, filter.shift);
+    convolutionKernel_.setArg(7, int(mode));
+
+    queue.enqueueNDRangeKernel(convolutionKernel_, cl::NullRange, cl::NDRange(roundUp(width, WGX), roundUp(height, WGY)),
+                               cl::NDRange(WGX, WGY), nullptr, event);
+}
+
+void FixedPointBlur::enqueueRotational(cl::CommandQueue& queue,
+                                       cl::Buffer const& devInputImage,
+                                       cl::Buffer& devOutputImage,
+                                       int width,
+                                       int height,
+                                       float angle,
+                                       RotationalSampling const& sampling,
+                                       cl::Event* event)
+{
+    rotationalKernel_.setArg(0, devInputImage);
+    rotationalKernel_.setArg(1, devOutputImage);
+    rotationalKernel_.setArg(2, width);
+    rotationalKernel_.setArg(3, height);
+    rotationalKernel_.setArg(4, angle);
+    rotationalKernel_.setArg(5, sampling.density);
+    rotationalKernel_.setArg(6, sampling.maxSamples);
+
+    queue.enqueueNDRangeKernel(rotationalKernel_, cl::NullRange, cl::NDRange(roundUp(width, WGX), roundUp(height, WGY)),
+                               cl::NDRange(WGX, WGY), nullptr, event);
+}
@@ -0,0 +1,108 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded multi-producer multi-consumer queue without locks (Vyukov's
+// array queue). Every cell carries a sequence number that tells whether
+// it is free for the push or ready for the pop of the current lap; a
+// thread claims a cell by advancing the tail or head with a CAS and
+// publishes it through the sequence, so pushes and pops on different
+// cells never wait for each other.
+template <typename T>
+struct LockFreeQueue
+{
+    // `capacity` is rounded up to a power of two
+    LockFreeQueue(size_t capacity) :
+        cells_ (),
+        mask_ (0),
+        tail_ (0),
+        head_ (0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        mask_ = size - 1;
+    }
+
+    // False if the queue is full
+    bool push(T const& value)
+    {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells_[position & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto lap = static_cast<std::ptrdiff_t>(sequence - position);
+
+            if (lap == 0)
+            {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lap < 0)
+                return false;
+            else
+                position = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    // False if no value is ready, including one whose push is not
+    // finished yet
+    bool pop(T& value)
+    {
+        size_t position = head_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells_[position & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto lap = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+
+            if (lap == 0)
+            {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lap < 0)
+                return false;
+            else
+                position = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Whether pushes were claimed that no pop has claimed yet. Only a
+    // hint while other threads use the queue.
+    bool empty() const
+    {
+        return head_.load() == tail_.load();
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    // On their own cache lines, producers and consumers do not share them
+    alignas(64) std::atomic<size_t> tail_;
+    alignas(64) std::atomic<size_t> head_;
+};
+
+#endif // LOCK_FREE_QUEUE_H
@@ -0,0 +1,100 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+// Map with a byte budget, least recently used entries are evicted first.
+// Keys need operator<, the size of a value is given when it is inserted.
+template <typename Key, typename Value>
+struct LruCache
+{
+    LruCache(size_t budget) :
+        budget_ (budget),
+        used_ (0),
+        entries_ (),
+        index_ ()
+    {
+    }
+
+    // Returns the value and marks it as most recently used, or nullptr
+    Value* find(Key const& key)
+    {
+        auto found = index_.find(key);
+        if (found == index_.end())
+            return nullptr;
+
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return &entries_.front().value;
+    }
+
+    // Evicts until `bytes` fit. Returns nullptr and stores nothing if
+    // they do not fit even into an empty cache.
+    Value* insert(Key const& key, Value value, size_t bytes)
+    {
+        erase(key);
+        if (bytes > budget_)
+            return nullptr;
+
+        evict(bytes);
+
+        entries_.push_front(Entry {key, std::move(value), bytes});
+        index_[key] = entries_.begin();
+        used_ += bytes;
+
+        return &entries_.front().value;
+    }
+
+    void erase(Key const& key)
+    {
+        auto found = index_.find(key);
+        if (found == index_.end())
+            return;
+
+        used_ -= found->second->bytes;
+        entries_.erase(found->second);
+        index_.erase(found);
+    }
+
+    void setBudget(size_t budget)
+    {
+        budget_ = budget;
+        evict(0);
+    }
+
+    size_t budget() const
+    {
+        return budget_;
+    }
+
+    size_t used() const
+    {
+        return used_;
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        size_t bytes;
+    };
+
+    void evict(size_t needed)
+    {
+        while (!entries_.empty() && used_ + needed > budget_)
+        {
+            used_ -= entries_.back().bytes;
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+        }
+    }
+
+    size_t budget_;
+    size_t used_;
+    std::list<Entry> entries_;  // most recently used first
+    std::map<Key, typename std::list<Entry>::iterator> index_;
+};
+
+#endif // LRU_CACHE_H
@@ -1,127 +1,47 @@
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <signal.h>
 #include <CImg.h>
 
 #include "opencl.h"
+#include "blur-daemon.h"
+#include "convolution.h"
 
 #define NON_OPTIMIZED
 //#define READ_ALIGNED
 //#define READ4
-
-constexpr unsigned WGX(16);
-constexpr unsigned WGY(16);
+// Sums in half where the device has cl_khr_fp16, for previews
+//#define HALF_PRECISION
 
 OpenCL ocl(DEVICE_GPU);
 
-// This function takes a positive integer and rounds it up to
-// the nearest multiple of another provided integer
-unsigned int roundUp(unsigned value, unsigned multiple) 
+#ifdef NON_OPTIMIZED
+// One engine per context and precision for the whole run of the program,
+// so that its kernels are built once rather than for every image
+static Convolution& convolution_engine(cl::Context const& context, Precision precision)
 {
-    // Determine how far past the nearest multiple the value is
-    auto remainder = value % multiple;
-    // Add the difference to make the value a multiple
-    if(remainder != 0) 
-    {
-        value += (multiple - remainder);
-    }
-    
-    return value;
-}
+    static std::map<std::pair<cl_context, Precision>, std::unique_ptr<Convolution>> engines;
 
-#define KERNEL_SOURCE(source) #source
+    auto& engine = engines[std::make_pair(context(), precision)];
+    if (!engine)
+        engine.reset(new Convolution(context, false, precision));
+
+    return *engine;
+}
+#endif
 
 template <typename Image>
 int blur_image(Image const& inputImage, Image& outputImage)
 {
-    static const std::string kernel_source = KERNEL_SOURCE(
-        __kernel void convolution(__global float* imageIn, 
-                                  __global float* imageOut,
-                                  __constant float* filter,
-                                  int rows,
-                                  int cols,
-                                  int filterWidth,
-                                  __local float* localImage,
-                                  int localHeight,
-                                  int localWidth)
-        {
-            // Determine the amount of padding for this filter
-            int filterRadius = filterWidth / 2;
-            int padding = filterRadius * 2;
-            
-            // Determine the size of the workgroup output region
-            int groupStartCol = get_group_id(0)*get_local_size(0);
-            int groupStartRow = get_group_id(1)*get_local_size(1);
-            
-            // Determine the local ID of each work-item
-            int localCol = get_local_id(0);
-            int localRow = get_local_id(1);
-
-            // Determine the global ID of each work-item. work-items
-            // representing the output region will have a unique global
-            // ID
-            int globalCol = groupStartCol + localCol;
-            int globalRow = groupStartRow + localRow;
-
-            // Cache the data to local memory
-            // Step down rows
-            for (int i = localRow; i < localHeight; i += get_local_size(1)) 
-            {
-                int curRow = groupStartRow + i;
-                // Step across columns
-                for (int j = localCol; j < localWidth; j += get_local_size(0)) 
-                {
-                    int curCol = groupStartCol + j;
-                    
-                    // Perform the read if it is in bounds
-                    if (curRow < rows && curCol < cols)
-                    {
-                        localImage[i*localWidth + j] = imageIn[curRow*cols+curCol];
-                    }
-                }
-            }
-            
-            barrier(CLK_LOCAL_MEM_FENCE);
-
-            // Perform the convolution
-            if (globalRow < rows-padding && globalCol < cols-padding) 
-            {
-                // Each work-item will filter around its start location
-                //(starting from the filter radius left and up)
-                float sum = 0.0f;
-                int filterIdx = 0;
-                // Not unrolled
-                for (int i = localRow; i < localRow+filterWidth; i++) 
-                {
-                    int offset = i*localWidth;
-                    for (int j = localCol; j < localCol+filterWidth; j++)
-                    {
-                        sum += localImage[offset+j] * filter[filterIdx++];
-                    }
-                }
-                
-                /*
-                // Inner loop unrolled
-                for (int i = localRow; i < localRow+filterWidth; i++) 
-                {
-                    int offset = i*localWidth+localCol;
-                    sum += localImage[offset++] * filter[filterIdx++];
-                    sum += localImage[offset++] * filter[filterIdx++];
-                    sum += localImage[offset++] * filter[filterIdx++];
-                    sum += localImage[offset++] * filter[filterIdx++];
-                    sum += localImage[offset++] * filter[filterIdx++];
-                    sum += localImage[offset++] * filter[filterIdx++];
-                    sum += localImage[offset++] * filter[filterIdx++];
-                }
-                */
-                
-                // Write the data out
-                imageOut[(globalRow+filterRadius)*cols + (globalCol+filterRadius)] = sum;
-            }
-
-            return;
-        }
-    );
-    
     int ret = CL_SUCCESS;
     
     try {
@@ -154,7 +74,6 @@ int blur_image(Image const& inputImage, Image& outputImage)
     
     int filterWidth = 7;
     int filterRadius = filterWidth/2;
-    int paddingPixels = (int)(filterWidth/2) * 2;
     
     auto context = ocl.context();
     auto devices = context.getInfo<CL_CONTEXT_DEVICES>();
@@ -167,15 +86,11 @@ int blur_image(Image const& inputImage, Image& outputImage)
     
     auto device = devices.front();
     
-    //cl::Program::Sources programSource(1, std::make_pair(kernel_source.data(), kernel_source.size()));
-    cl::Program program(context, kernel_source);
-    program.build(devices);
-    
-    for (auto& dev : devices)
-    {
-        std::string build_output = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(dev);
-        std::cout << "BUILD INFO: " << build_output << std::endl;
-    }
+#ifdef HALF_PRECISION
+    auto precision = convolution_precision(device, PRECISION_HALF);
+#else
+    auto precision = PRECISION_FLOAT;
+#endif
     
     cl::CommandQueue queue(context, device);
     
@@ -195,7 +110,45 @@ int blur_image(Image const& inputImage, Image& outputImage)
 #endif
     queue.enqueueWriteBuffer(devFilter, CL_TRUE, 0, 49*sizeof(float), filter);
     
-#if defined NON_OPTIMIZED || defined READ_ALIGNED
+#ifdef NON_OPTIMIZED
+    // Interior groups without bounds checks, then the border pixels with
+    // their taps clamped to the image; row segments on CPU devices
+    auto& convolution = convolution_engine(context, precision);
+    convolution.enqueue(queue, devInputImage, devOutputImage, devFilter, devw, devh, filterWidth);
+    queue.finish();
+#ifdef HALF_PRECISION
+    // How far the half sums stray from float on this image
+    if (convolution.precision() == PRECISION_HALF)
+    {
+        auto& reference = convolution_engine(context, PRECISION_FLOAT);
+        cl::Buffer devReferenceImage(context, CL_MEM_WRITE_ONLY, devDataSize);
+        reference.enqueue(queue, devInputImage, devReferenceImage, devFilter, devw, devh, filterWidth);
+        
+        std::vector<float> half(devw*devh);
+        std::vector<float> full(devw*devh);
+        queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, devDataSize, half.data());
+        queue.enqueueReadBuffer(devReferenceImage, CL_TRUE, 0, devDataSize, full.data());
+        
+        float maxError = 0.0f;
+        for (size_t i = 0; i < half.size(); i++)
+            maxError = std::max(maxError, std::fabs(half[i] - full[i]));
+        std::cout << "Half precision max error: " << maxError << std::endl;
+    }
+#endif
+#else // READ_ALIGNED jj READ4
+    //cl::Program::Sources programSource(1, std::make_pair(kernel_source.data(), kernel_source.size()));
+    cl::Program program(context, convolution_precision_source(false) + convolution_kernel_source);
+    program.build(devices, convolution_precision_options(precision).c_str());
+    
+    for (auto& dev : devices)
+    {
+        std::string build_output = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(dev);
+        std::cout << "BUILD INFO: " << build_output << std::endl;
+    }
+    
+    int paddingPixels = (int)(filterWidth/2) * 2;
+    
+#ifdef READ_ALIGNED
     cl::Kernel kernel(program, "convolution");
 #else // READ4
     cl::Kernel kernel(program, "convolution_read4");
@@ -212,7 +165,7 @@ int blur_image(Image const& inputImage, Image& outputImage)
     cl::NDRange globalSize {totalWorkItemsX, totalWorkItemsY};
     // The amount of local data that is cached is the size of the
     // workgroups plus the padding pixels
-#if defined NON_OPTIMIZED || defined READ_ALIGNED
+#ifdef READ_ALIGNED
     int localWidth = localSize[0] + paddingPixels;
 #else // READ4
     // Round the local width up to 4 for the read4 kernel
@@ -235,6 +188,7 @@ int blur_image(Image const& inputImage, Image& outputImage)
     // Execute the kernel
     queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize);
     queue.finish();
+#endif
     
     // Read back the output image
 #ifdef NON_OPTIMIZED
@@ -267,13 +221,83 @@ int blur_image(Image const& inputImage, Image& outputImage)
     return ret;
 }
 
+static std::atomic<BlurDaemon*> runningDaemon(nullptr);
+
+static void stop_daemon(int)
+{
+    if (BlurDaemon* daemon = runningDaemon)
+        daemon->stop();
+}
+
+// Points SIGINT and SIGTERM at stop_daemon() for `daemon` while it lives.
+// Declared after the daemon, it puts the previous handlers back and
+// forgets the daemon before the daemon is destroyed, whether run()
+// returns or throws.
+struct DaemonSignals
+{
+    DaemonSignals(BlurDaemon& daemon)
+    {
+        runningDaemon = &daemon;
+
+        struct sigaction action;
+        std::memset(&action, 0, sizeof action);
+        action.sa_handler = stop_daemon;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, &previousInt_);
+        sigaction(SIGTERM, &action, &previousTerm_);
+    }
+
+    ~DaemonSignals()
+    {
+        sigaction(SIGINT, &previousInt_, nullptr);
+        sigaction(SIGTERM, &previousTerm_, nullptr);
+        runningDaemon = nullptr;
+    }
+
+    DaemonSignals(DaemonSignals const&) = delete;
+    DaemonSignals& operator=(DaemonSignals const&) = delete;
+
+private:
+    struct sigaction previousInt_;
+    struct sigaction previousTerm_;
+};
+
+// blur_test --daemon SOCKET, serves requests (blur-daemon.h) with the
+// programs built once until SIGINT or SIGTERM
+int serve(char const* path)
+{
+    int ret = 0;
+
+    try
+    {
+        BlurDaemon daemon(ocl.context(), path);
+        DaemonSignals signals(daemon);
+
+        std::cout << "Serving on " << path << std::endl;
+        daemon.run();
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        ret = err.err();
+    }
+    catch (std::system_error const& err)
+    {
+        std::cerr << "ERROR: blur daemon => " << err.what() << std::endl;
+        ret = -1;
+    }
+
+    return ret;
+}
+
 int main(int argc, char **argv) 
 {
     using namespace cimg_library;
     
     std::cout << "Hello, world!" << std::endl;
     
-    if (argc != 2)
+    bool daemon = argc == 3 && std::string(argv[1]) == "--daemon";
+    if (argc != 2 && !daemon)
     {
         std::cerr << "ERROR: filename missing" << std::endl;
         return -1;
@@ -286,6 +310,9 @@ int main(int argc, char **argv)
         return -1;
     }
 #endif    
+    if (daemon)
+        return serve(argv[2]);
+
     //auto context = ocl.context();
     std::string fname(argv[1]);
     const unsigned char red[] = { 255,0,0 }, green[] = { 0,255,0 }, blue[] = { 0,0,255 };
@@ -1,9 +1,14 @@
 
+#ifndef OPENCL_H
+#define OPENCL_H
+
 #include <iostream>
 
 #define __CL_ENABLE_EXCEPTIONS
 #include <CL/cl.hpp>
 
+#define KERNEL_SOURCE(source) #source
+
 enum PlatformType
 {
     PLATFORM_AMD,
@@ -21,6 +26,8 @@ enum DeviceType : cl_device_type
 };
 
 static const char* AMD_PLATFORM_ID = "Advanced Micro Devices, Inc.";
+static const char* NVIDIA_PLATFORM_ID = "NVIDIA Corporation";
+static const char* INTEL_PLATFORM_ID = "Intel(R) Corporation";
 
 struct OpenCL
 {
@@ -53,7 +60,7 @@ private:
     cl::Platform platform_;
 };
 
-int OpenCL::init(PlatformType type)
+inline int OpenCL::init(PlatformType type)
 {
     int ret = CL_INVALID_PLATFORM;
     
@@ -61,6 +68,10 @@ int OpenCL::init(PlatformType type)
     {
         if (!id.compare(AMD_PLATFORM_ID))
             return PLATFORM_AMD;
+        if (!id.compare(NVIDIA_PLATFORM_ID))
+            return PLATFORM_NVIDIA;
+        if (!id.compare(INTEL_PLATFORM_ID))
+            return PLATFORM_INTEL;
         
         return PLATFORM_UNKNOWN;
     };
@@ -110,3 +121,5 @@ int OpenCL::init(PlatformType type)
 
     return ret;
 }
+
+#endif // OPENCL_H
@@ -0,0 +1,93 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "opencl.h"
+
+// Exact float literal for generated source, hex floats are valid OpenCL C
+inline std::string kernel_literal(float value)
+{
+    std::ostringstream literal;
+    literal << std::hexfloat << double(value) << 'f';
+    return literal.str();
+}
+
+// Programs built from generated source on one device, kept by source.
+// Engines that generate code (StencilChain, GeneratedConvolution) get the
+// cache of their device from forDevice(), so a program is compiled once
+// per device however many engines use it. Each engine creates its own
+// kernels from it: kernel arguments are state, kernel objects are not
+// shared between engines.
+struct ProgramCache
+{
+    ProgramCache(cl::Context const& context, cl::Device const& device) :
+        context_ (context),
+        device_ (device),
+        mutex_ (),
+        programs_ ()
+    {
+    }
+
+    // The cache of `device` in `context`, created on first use and kept
+    // while an engine holds it
+    static std::shared_ptr<ProgramCache> forDevice(cl::Context const& context, cl::Device const& device)
+    {
+        static std::mutex registryMutex;
+        static std::map<std::pair<cl_context, cl_device_id>, std::weak_ptr<ProgramCache>> registry;
+
+        // A live cache holds its context, so the handles are not reused
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto& entry = registry[std::make_pair(context(), device())];
+        auto cache = entry.lock();
+        if (!cache)
+        {
+            cache = std::make_shared<ProgramCache>(context, device);
+            entry = cache;
+        }
+        return cache;
+    }
+
+    // Builds `source` the first time, prints the build log if that fails
+    cl::Program program(std::string const& source)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = programs_.find(source);
+        if (found != programs_.end())
+            return found->second;
+
+        cl::Program program(context_, source);
+        try
+        {
+            program.build({device_});
+        }
+        catch (cl::Error const&)
+        {
+            std::cerr << "BUILD INFO: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+            throw;
+        }
+
+        return programs_[source] = program;
+    }
+
+    // Programs built so far
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return programs_.size();
+    }
+
+private:
+    cl::Context context_;
+    cl::Device device_;
+    std::mutex mutex_;
+    std::map<std::string, cl::Program> programs_;
+};
+
+#endif // PROGRAM_CACHE_H
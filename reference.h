@@ -0,0 +1,688 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "convolution.h"
+
+// Scalar CPU versions of the OpenCL kernels. They are slow on purpose:
+// straightforward loops that the device outputs are checked against.
+
+// Single channel convolution as computed by the `convolution` kernel.
+// Only the interior (filterRadius pixels away from the border) is written.
+inline void reference_convolution(float const* imageIn, float* imageOut, int rows, int cols,
+                                  float const* filter, int filterWidth)
+{
+    int filterRadius = filterWidth / 2;
+
+    for (int row = filterRadius; row < rows - filterRadius; row++)
+    {
+        for (int col = filterRadius; col < cols - filterRadius; col++)
+        {
+            float sum = 0.0f;
+            for (int i = 0; i < filterWidth; i++)
+            {
+                for (int j = 0; j < filterWidth; j++)
+                {
+                    sum += imageIn[(row - filterRadius + i)*cols + col - filterRadius + j] * filter[i*filterWidth + j];
+                }
+            }
+            imageOut[row*cols + col] = sum;
+        }
+    }
+}
+
+// float4 convolution, the intended result of the p4.cl `convolve*` kernels.
+// Only the interior is written; alpha is forced to 1 like the kernels do.
+inline void reference_convolution4(float const* imageIn, float* imageOut, int width, int height,
+                                   float const* filter, int filterWidth)
+{
+    int filterRadius = filterWidth / 2;
+
+    for (int y = filterRadius; y < height - filterRadius; y++)
+    {
+        for (int x = filterRadius; x < width - filterRadius; x++)
+        {
+            float sum[3] = {0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < filterWidth; i++)
+            {
+                for (int j = 0; j < filterWidth; j++)
+                {
+                    float const* pixel = imageIn + 4*((y - filterRadius + i)*width + x - filterRadius + j);
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += pixel[c] * filter[i*filterWidth + j];
+                }
+            }
+
+            float* out = imageOut + 4*(y*width + x);
+            out[0] = sum[0];
+            out[1] = sum[1];
+            out[2] = sum[2];
+            out[3] = 1.0f;
+        }
+    }
+}
+
+// Every pixel of an image of `channels` interleaved floats convolved,
+// taps outside the image read through border_index() like the
+// convolution_border kernel
+inline void reference_convolution_border(float const* imageIn, float* imageOut, int width, int height, int channels,
+                                         float const* filter, int filterWidth, BorderMode mode)
+{
+    int filterRadius = filterWidth / 2;
+    std::vector<double> sum(channels);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            std::fill(sum.begin(), sum.end(), 0.0);
+            for (int i = 0; i < filterWidth; i++)
+            {
+                int sy = border_index(y - filterRadius + i, height, mode);
+                for (int j = 0; j < filterWidth; j++)
+                {
+                    int sx = border_index(x - filterRadius + j, width, mode);
+                    for (int c = 0; c < channels; c++)
+                        sum[c] += imageIn[channels*(sy*width + sx) + c] * filter[i*filterWidth + j];
+                }
+            }
+
+            for (int c = 0; c < channels; c++)
+                imageOut[channels*(y*width + x) + c] = float(sum[c]);
+        }
+    }
+}
+
+// All four channels of a float4 image convolved with every tap read
+// clamped to the image edges, as StencilChain stages do
+inline void reference_convolution4_clamped(float const* imageIn, float* imageOut, int width, int height,
+                                           float const* filter, int filterWidth)
+{
+    reference_convolution_border(imageIn, imageOut, width, height, 4, filter, filterWidth, BORDER_CLAMP);
+}
+
+// Colour matrix of 4 rows of (r, g, b, a, offset) applied to every pixel
+inline void reference_color_matrix(float const* imageIn, float* imageOut, int width, int height, float const* matrix)
+{
+    for (size_t i = 0; i < size_t(width) * height; i++)
+    {
+        double out[4];
+        for (int row = 0; row < 4; row++)
+        {
+            out[row] = matrix[5*row + 4];
+            for (int c = 0; c < 4; c++)
+                out[row] += matrix[5*row + c] * double(imageIn[4*i + c]);
+        }
+
+        for (int c = 0; c < 4; c++)
+            imageOut[4*i + c] = float(out[c]);
+    }
+}
+
+// Spin blur of a float4 image, same sampling pattern as the
+// `rotational_blur` kernel (see rotational-blur.cpp).
+inline void reference_rotational_blur(float const* imageIn, float* imageOut, int width, int height, float angle,
+                                      float density = 1.0f, int maxSamples = 0, int levels = 1)
+{
+    // Input followed by levels - 1 2x2 box filtered levels, in float like
+    // the rotational_downsample kernel
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<float> pixels;
+    };
+
+    std::vector<Level> pyramid;
+    pyramid.push_back(Level {width, height, std::vector<float>(imageIn, imageIn + 4*width*height)});
+    for (int level = 1; level < levels; level++)
+    {
+        Level const& in = pyramid.back();
+        Level out {(in.width + 1) / 2, (in.height + 1) / 2, {}};
+        out.pixels.resize(4 * out.width * out.height);
+
+        for (int y = 0; y < out.height; y++)
+        {
+            for (int x = 0; x < out.width; x++)
+            {
+                int x1 = std::min(2*x + 1, in.width - 1);
+                int y1 = std::min(2*y + 1, in.height - 1);
+                for (int c = 0; c < 4; c++)
+                {
+                    out.pixels[4*(y*out.width + x) + c] =
+                        0.25f * (in.pixels[4*(2*y*in.width + 2*x) + c] + in.pixels[4*(2*y*in.width + x1) + c] +
+                                 in.pixels[4*(y1*in.width + 2*x) + c] + in.pixels[4*(y1*in.width + x1) + c]);
+                }
+            }
+        }
+
+        pyramid.push_back(std::move(out));
+    }
+
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            double dx = x - cx;
+            double dy = y - cy;
+            double radius = std::sqrt(dx*dx + dy*dy);
+            double theta = std::atan2(dy, dx);
+
+            // Sample count and level in single precision so that they
+            // match the kernel
+            float radiusf = std::sqrt(float(dx*dx + dy*dy));
+            int samples = std::max(1, int(std::ceil(radiusf * angle * density)));
+            if (maxSamples > 0)
+                samples = std::min(samples, maxSamples);
+            double step = double(angle) / samples;
+            double start = theta - 0.5 * angle + 0.5 * step;
+
+            int level = std::min(levels - 1, int(std::floor(std::log2(std::max(radiusf * (angle / samples), 1.0f)))));
+            Level const& image = pyramid[level];
+            double scale = 1.0 / (1 << level);
+
+            auto fetch = [&](int x, int y, int c)
+            {
+                x = std::min(std::max(x, 0), image.width - 1);
+                y = std::min(std::max(y, 0), image.height - 1);
+                return double(image.pixels[4*(y*image.width + x) + c]);
+            };
+
+            double sum[4] = {0.0, 0.0, 0.0, 0.0};
+            for (int i = 0; i < samples; i++)
+            {
+                double t = start + i * step;
+                double sx = (cx + radius * std::cos(t) + 0.5) * scale - 0.5;
+                double sy = (cy + radius * std::sin(t) + 0.5) * scale - 0.5;
+                double fx = std::floor(sx);
+                double fy = std::floor(sy);
+                double ax = sx - fx;
+                double ay = sy - fy;
+                int x0 = int(fx);
+                int y0 = int(fy);
+
+                for (int c = 0; c < 4; c++)
+                {
+                    double top = fetch(x0, y0, c) * (1.0 - ax) + fetch(x0 + 1, y0, c) * ax;
+                    double bottom = fetch(x0, y0 + 1, c) * (1.0 - ax) + fetch(x0 + 1, y0 + 1, c) * ax;
+                    sum[c] += top * (1.0 - ay) + bottom * ay;
+                }
+            }
+
+            for (int c = 0; c < 4; c++)
+                imageOut[4*(y*width + x) + c] = float(sum[c] / samples);
+        }
+    }
+}
+
+// Spin blur with an angle per pixel, same sampling as
+// RotationalBlur::enqueueAngleMap(): the sample count of every arc is
+// rounded up to the next of 1..7, 8, 10, 12, 14, 16, 20, ... (four steps
+// per octave), at most 131072.
+inline void reference_rotational_blur_map(float const* imageIn, float* imageOut, int width, int height,
+                                          float const* angleMap, float density = 1.0f, int maxSamples = 0)
+{
+    auto fetch = [&](int x, int y, int c)
+    {
+        x = std::min(std::max(x, 0), width - 1);
+        y = std::min(std::max(y, 0), height - 1);
+        return double(imageIn[4*(y*width + x) + c]);
+    };
+
+    auto ladder = [](int samples)
+    {
+        if (samples < 8)
+            return samples;
+        for (int octave = 3; octave < 17; octave++)
+            for (int steps = 4; steps < 8; steps++)
+                if ((steps << (octave - 2)) >= samples)
+                    return steps << (octave - 2);
+        return 131072;
+    };
+
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            double dx = x - cx;
+            double dy = y - cy;
+            double radius = std::sqrt(dx*dx + dy*dy);
+            double theta = std::atan2(dy, dx);
+            float angle = angleMap[y*width + x];
+
+            int samples = std::max(1, int(std::ceil(std::sqrt(float(dx*dx + dy*dy)) * angle * density)));
+            if (maxSamples > 0)
+                samples = std::min(samples, maxSamples);
+            samples = ladder(samples);
+            double step = double(angle) / samples;
+            double start = theta - 0.5 * angle + 0.5 * step;
+
+            double sum[4] = {0.0, 0.0, 0.0, 0.0};
+            for (int i = 0; i < samples; i++)
+            {
+                double t = start + i * step;
+                double sx = cx + radius * std::cos(t);
+                double sy = cy + radius * std::sin(t);
+                double fx = std::floor(sx);
+                double fy = std::floor(sy);
+                double ax = sx - fx;
+                double ay = sy - fy;
+                int x0 = int(fx);
+                int y0 = int(fy);
+
+                for (int c = 0; c < 4; c++)
+                {
+                    double top = fetch(x0, y0, c) * (1.0 - ax) + fetch(x0 + 1, y0, c) * ax;
+                    double bottom = fetch(x0, y0 + 1, c) * (1.0 - ax) + fetch(x0 + 1, y0 + 1, c) * ax;
+                    sum[c] += top * (1.0 - ay) + bottom * ay;
+                }
+            }
+
+            for (int c = 0; c < 4; c++)
+                imageOut[4*(y*width + x) + c] = float(sum[c] / samples);
+        }
+    }
+}
+
+// Bilinear samples of the polar rings of RotationalSweep: ring r has
+// 64 * ceil(2*pi*r / 64) bins, bin k at angle (k + 0.5) * 2pi / bins.
+// rings[ring][4*k + c] is channel c of bin k.
+inline std::vector<std::vector<double>> reference_polar_rings(float const* imageIn, int width, int height)
+{
+    constexpr double Pi = 3.14159265358979323846;
+
+    auto fetch = [&](int x, int y, int c)
+    {
+        x = std::min(std::max(x, 0), width - 1);
+        y = std::min(std::max(y, 0), height - 1);
+        return double(imageIn[4*(y*width + x) + c]);
+    };
+
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+    std::vector<std::vector<double>> rings(int(std::sqrt(cx*cx + cy*cy)) + 2);
+
+    for (int ring = 0; ring < int(rings.size()); ring++)
+    {
+        int bins = 64 * std::max(1, int(std::ceil(2.0 * Pi * ring / 64)));
+        auto& values = rings[ring];
+        values.resize(4 * bins);
+
+        for (int k = 0; k < bins; k++)
+        {
+            double phi = (k + 0.5) * 2.0 * Pi / bins;
+            double sx = cx + ring * std::cos(phi);
+            double sy = cy + ring * std::sin(phi);
+            double fx = std::floor(sx);
+            double fy = std::floor(sy);
+            double ax = sx - fx;
+            double ay = sy - fy;
+            int x0 = int(fx);
+            int y0 = int(fy);
+
+            for (int c = 0; c < 4; c++)
+            {
+                double top = fetch(x0, y0, c) * (1.0 - ax) + fetch(x0 + 1, y0, c) * ax;
+                double bottom = fetch(x0, y0 + 1, c) * (1.0 - ax) + fetch(x0 + 1, y0 + 1, c) * ax;
+                values[4*k + c] = top * (1.0 - ay) + bottom * ay;
+            }
+        }
+    }
+
+    return rings;
+}
+
+// Angle sweep blur, same polar rings and bins as RotationalSweep (see
+// rotational-sweep.h) in double precision
+inline void reference_rotational_sweep(float const* imageIn, float* imageOut, int width, int height, float angle)
+{
+    constexpr double Pi = 3.14159265358979323846;
+
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+    auto bins = reference_polar_rings(imageIn, width, height);
+    int rings = int(bins.size());
+
+    // Prefix sums of the bins of every ring, prefix[ring][4*k + c] is the
+    // sum of bins 0..k-1
+    std::vector<std::vector<double>> prefix(rings);
+    for (int ring = 0; ring < rings; ring++)
+    {
+        auto& sums = prefix[ring];
+        sums.assign(bins[ring].size() + 4, 0.0);
+        for (size_t i = 0; i < bins[ring].size(); i++)
+            sums[i + 4] = sums[i] + bins[ring][i];
+    }
+
+    // Whole turns, bin and fraction of position u, bin k covers k..k+1
+    auto locate = [&](int bins, double u, double& turns, int& k)
+    {
+        turns = std::floor(u / bins);
+        double rest = u - turns * bins;
+        k = std::min(std::max(int(std::floor(rest)), 0), bins - 1);
+        return rest - k;
+    };
+
+    auto mean = [&](int ring, double theta, int c)
+    {
+        auto const& sums = prefix[ring];
+        int bins = int(sums.size() / 4) - 1;
+        double scale = bins / (2.0 * Pi);
+        double u0 = (theta - 0.5 * angle) * scale;
+        double u1 = (theta + 0.5 * angle) * scale;
+
+        double turns0;
+        double turns1;
+        int k0;
+        int k1;
+        double f0 = locate(bins, u0, turns0, k0);
+        double f1 = locate(bins, u1, turns1, k1);
+        double bin0 = sums[4*(k0 + 1) + c] - sums[4*k0 + c];
+        double bin1 = sums[4*(k1 + 1) + c] - sums[4*k1 + c];
+
+        if (u1 <= u0)
+            return bin0;
+
+        double sum0 = turns0 * sums[4*bins + c] + sums[4*k0 + c] + f0 * bin0;
+        double sum1 = turns1 * sums[4*bins + c] + sums[4*k1 + c] + f1 * bin1;
+        return (sum1 - sum0) / (u1 - u0);
+    };
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            double dx = x - cx;
+            double dy = y - cy;
+            double radius = std::sqrt(dx*dx + dy*dy);
+            double theta = std::atan2(dy, dx);
+            int inner = std::min(int(radius), rings - 2);
+            double t = radius - inner;
+
+            for (int c = 0; c < 4; c++)
+                imageOut[4*(y*width + x) + c] = float(mean(inner, theta, c) * (1.0 - t) + mean(inner + 1, theta, c) * t);
+        }
+    }
+}
+
+// Gaussian spin blur of RotationalSweep::enqueueGaussian() in double: the
+// same recursive filter with the same lead-in along every ring, then the
+// rings interpolated in angle and radius
+inline void reference_rotational_gaussian(float const* imageIn, float* imageOut, int width, int height, float sigma)
+{
+    constexpr double Pi = 3.14159265358979323846;
+
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+    auto rings = reference_polar_rings(imageIn, width, height);
+
+    for (auto& values : rings)
+    {
+        int bins = int(values.size() / 4);
+        double s = sigma * bins / (2.0 * Pi);
+        if (s < 0.5)
+            continue;
+
+        double q = s >= 2.5 ? 0.98711 * s - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * s);
+        double b0 = 1.57825 + 2.44413 * q + 1.4281 * q*q + 0.422205 * q*q*q;
+        double a1 = (2.44413 * q + 2.85619 * q*q + 1.26661 * q*q*q) / b0;
+        double a2 = -(1.4281 * q*q + 1.26661 * q*q*q) / b0;
+        double a3 = 0.422205 * q*q*q / b0;
+        double gain = 1.0 - (a1 + a2 + a3);
+        int lead = std::min(bins, int(4.0 * s) + 3);
+
+        for (int c = 0; c < 4; c++)
+        {
+            std::vector<double> forward(bins);
+            double w[3];
+            std::fill(w, w + 3, values[4*(bins - lead) + c]);
+            for (int k = bins - lead; k < 2 * bins; k++)
+            {
+                double next = gain * values[4*(k % bins) + c] + a1 * w[0] + a2 * w[1] + a3 * w[2];
+                w[2] = w[1];
+                w[1] = w[0];
+                w[0] = next;
+                if (k >= bins)
+                    forward[k - bins] = next;
+            }
+
+            std::fill(w, w + 3, forward[lead - 1]);
+            for (int k = lead - 1 + bins; k >= 0; k--)
+            {
+                double next = gain * forward[k % bins] + a1 * w[0] + a2 * w[1] + a3 * w[2];
+                w[2] = w[1];
+                w[1] = w[0];
+                w[0] = next;
+                if (k < bins)
+                    values[4*k + c] = next;
+            }
+        }
+    }
+
+    auto sample = [&](int ring, double theta, int c)
+    {
+        auto const& values = rings[ring];
+        int bins = int(values.size() / 4);
+        double v = theta * bins / (2.0 * Pi) - 0.5;
+        double fv = std::floor(v);
+        int k0 = (int(fv) + bins) % bins;
+        int k1 = (k0 + 1) % bins;
+        return values[4*k0 + c] * (1.0 - (v - fv)) + values[4*k1 + c] * (v - fv);
+    };
+
+    int count = int(rings.size());
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            double dx = x - cx;
+            double dy = y - cy;
+            double radius = std::sqrt(dx*dx + dy*dy);
+            double theta = std::atan2(dy, dx);
+            int inner = std::min(int(radius), count - 2);
+            double t = radius - inner;
+
+            for (int c = 0; c < 4; c++)
+                imageOut[4*(y*width + x) + c] = float(sample(inner, theta, c) * (1.0 - t) + sample(inner + 1, theta, c) * t);
+        }
+    }
+}
+
+// Zoom blur of RotationalSweep::enqueueZoom() in double: the same spokes
+// sampled one pixel apart, a pixel is the mean of radii
+// r * (1 - strength/2) .. r * (1 + strength/2) blended between the two
+// spokes around it. Spokes are summed one at a time.
+inline void reference_zoom_blur(float const* imageIn, float* imageOut, int width, int height, float strength)
+{
+    constexpr double Pi = 3.14159265358979323846;
+
+    auto fetch = [&](int x, int y, int c)
+    {
+        x = std::min(std::max(x, 0), width - 1);
+        y = std::min(std::max(y, 0), height - 1);
+        return double(imageIn[4*(y*width + x) + c]);
+    };
+
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+    int rings = int(std::sqrt(cx*cx + cy*cy)) + 2;
+    int spokes = 64 * std::max(1, int(std::ceil(2.0 * Pi * (rings - 1) / 64)));
+    int length = 64 * int(std::ceil(1.5 * rings / 64));
+
+    // Every pixel reads the spoke below and above its angle
+    std::vector<std::vector<int>> readers(spokes);
+    std::vector<int> lower(size_t(width) * height);
+    std::vector<double> blend(size_t(width) * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            double v = std::atan2(y - cy, x - cx) * spokes / (2.0 * Pi) - 0.5;
+            double fv = std::floor(v);
+            int k0 = (int(fv) + spokes) % spokes;
+            lower[y*width + x] = k0;
+            blend[y*width + x] = v - fv;
+            readers[k0].push_back(y*width + x);
+            readers[(k0 + 1) % spokes].push_back(y*width + x);
+        }
+    }
+
+    std::vector<double> out(4 * blend.size(), 0.0);
+    std::vector<double> sums(4 * (length + 1));
+
+    for (int spoke = 0; spoke < spokes; spoke++)
+    {
+        // sums[4*j + c] is the sum of samples 0..j-1, sample j at radius j
+        double phi = (spoke + 0.5) * 2.0 * Pi / spokes;
+        for (int j = 0; j < length; j++)
+        {
+            double sx = cx + j * std::cos(phi);
+            double sy = cy + j * std::sin(phi);
+            double fx = std::floor(sx);
+            double fy = std::floor(sy);
+            double ax = sx - fx;
+            double ay = sy - fy;
+            int x0 = int(fx);
+            int y0 = int(fy);
+
+            for (int c = 0; c < 4; c++)
+            {
+                double top = fetch(x0, y0, c) * (1.0 - ax) + fetch(x0 + 1, y0, c) * ax;
+                double bottom = fetch(x0, y0 + 1, c) * (1.0 - ax) + fetch(x0 + 1, y0 + 1, c) * ax;
+                sums[4*(j + 1) + c] = sums[4*j + c] + top * (1.0 - ay) + bottom * ay;
+            }
+        }
+
+        // Sum up to position u, sample j covers j..j+1
+        auto sum = [&](double u, int c)
+        {
+            int k = std::min(int(u), length - 1);
+            return sums[4*k + c] + (u - k) * (sums[4*(k + 1) + c] - sums[4*k + c]);
+        };
+
+        for (int pixel : readers[spoke])
+        {
+            double dx = pixel % width - cx;
+            double dy = pixel / width - cy;
+            double radius = std::sqrt(dx*dx + dy*dy);
+            double u0 = std::min(std::max(radius * (1.0 - 0.5 * strength) + 0.5, 0.0), double(length));
+            double u1 = std::min(std::max(radius * (1.0 + 0.5 * strength) + 0.5, 0.0), double(length));
+
+            double weight = spoke == lower[pixel] ? 1.0 - blend[pixel] : blend[pixel];
+
+            for (int c = 0; c < 4; c++)
+            {
+                double mean;
+                if (u1 <= u0)
+                {
+                    int k = std::min(int(u0), length - 1);
+                    mean = sums[4*(k + 1) + c] - sums[4*k + c];
+                }
+                else
+                    mean = (sum(u1, c) - sum(u0, c)) / (u1 - u0);
+                out[4*pixel + c] += weight * mean;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < out.size(); i++)
+        imageOut[i] = float(out[i]);
+}
+
+// Shear backend of RotationalBlur in double: the mean of `rotations`
+// copies of the input, each rotated by three 1D shears with linear
+// interpolation on the same padded grids as the kernels
+inline void reference_rotational_shear(float const* imageIn, float* imageOut, int width, int height, float angle,
+                                       int rotations)
+{
+    constexpr double Pi = 3.14159265358979323846;
+
+    struct Shear
+    {
+        double alpha;
+        double beta;
+        bool flip;
+    };
+
+    std::vector<Shear> shears;
+    double maxAlpha = 0.0;
+    double maxBeta = 0.0;
+    for (int i = 0; i < rotations; i++)
+    {
+        double t = angle * ((i + 0.5) / rotations - 0.5);
+        bool flip = std::fabs(t) > 0.5 * Pi;
+        if (flip)
+            t -= t > 0 ? Pi : -Pi;
+        // Same float rounding of the shears as the kernel arguments
+        shears.push_back({double(float(-std::tan(0.5 * t))), double(float(std::sin(t))), flip});
+        maxAlpha = std::max(maxAlpha, std::fabs(shears.back().alpha));
+        maxBeta = std::max(maxBeta, std::fabs(shears.back().beta));
+    }
+
+    int marginX = int(std::ceil(maxAlpha * 0.5 * (height - 1))) + 1;
+    int shearedWidth = width + 2 * marginX;
+    int marginY = int(std::ceil(maxBeta * 0.5 * (shearedWidth - 1))) + 1;
+    int shearedHeight = height + 2 * marginY;
+
+    // Value of channel c at position u of `count` values `stride` apart
+    auto lerp = [](std::vector<double> const& values, size_t first, int stride, int count, double u, int c)
+    {
+        u = std::min(std::max(u, 0.0), double(count - 1));
+        int k0 = int(u);
+        int k1 = std::min(k0 + 1, count - 1);
+        return values[4*(first + size_t(k0) * stride) + c] * (1.0 - (u - k0)) +
+               values[4*(first + size_t(k1) * stride) + c] * (u - k0);
+    };
+
+    std::vector<double> input(imageIn, imageIn + 4 * size_t(width) * height);
+    std::vector<double> rows(4 * size_t(shearedWidth) * shearedHeight);
+    std::vector<double> columns(4 * size_t(shearedWidth) * height);
+    std::vector<double> sum(4 * size_t(width) * height, 0.0);
+
+    for (auto const& shear : shears)
+    {
+        for (int j = 0; j < shearedHeight; j++)
+        {
+            double ey = j - marginY - 0.5 * (height - 1);
+            int row = std::min(std::max(shear.flip ? height - 1 - j + marginY : j - marginY, 0), height - 1);
+            for (int i = 0; i < shearedWidth; i++)
+            {
+                double x = shear.flip ? width - 1 - i + marginX - shear.alpha * ey : i - marginX + shear.alpha * ey;
+                for (int c = 0; c < 4; c++)
+                    rows[4*(size_t(j)*shearedWidth + i) + c] = lerp(input, size_t(row) * width, 1, width, x, c);
+            }
+        }
+
+        for (int j = 0; j < height; j++)
+        {
+            for (int i = 0; i < shearedWidth; i++)
+            {
+                double fx = i - marginX - 0.5 * (width - 1);
+                for (int c = 0; c < 4; c++)
+                    columns[4*(size_t(j)*shearedWidth + i) + c] = lerp(rows, i, shearedWidth, shearedHeight, j + marginY + shear.beta * fx, c);
+            }
+        }
+
+        for (int y = 0; y < height; y++)
+        {
+            double dy = y - 0.5 * (height - 1);
+            for (int x = 0; x < width; x++)
+                for (int c = 0; c < 4; c++)
+                    sum[4*(size_t(y)*width + x) + c] += lerp(columns, size_t(y) * shearedWidth, 1, shearedWidth, x + marginX + shear.alpha * dy, c);
+        }
+    }
+
+    for (size_t i = 0; i < sum.size(); i++)
+        imageOut[i] = float(sum[i] / rotations);
+}
+
+#endif // REFERENCE_H
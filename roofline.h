@@ -0,0 +1,129 @@
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "opencl.h"
+
+// Peak rates of a device measured with two microkernels: a float4 copy
+// for streaming bandwidth and independent float4 mad chains for FLOPs.
+struct Roofline
+{
+    double bandwidth = 0;   // bytes/s
+    double flops = 0;       // FLOP/s
+
+    // Attainable FLOP/s at the given arithmetic intensity (FLOP/byte)
+    double attainable(double intensity) const
+    {
+        return std::min(flops, intensity * bandwidth);
+    }
+
+    // Intensity where the kernel stops being memory bound
+    double ridge() const
+    {
+        return bandwidth > 0 ? flops / bandwidth : 0;
+    }
+};
+
+static const std::string roofline_kernel_source = KERNEL_SOURCE(
+    __kernel void roofline_copy(__global const float4* in, __global float4* out)
+    {
+        size_t i = get_global_id(0);
+        out[i] = in[i];
+    }
+
+    // 8 independent chains hide the mad latency, 64 iterations of
+    // 8 float4 mads are 4096 FLOPs per work-item
+    __kernel void roofline_mad(__global float4* out, float a, float b)
+    {
+        float4 x0 = (float4)(get_global_id(0));
+        float4 x1 = x0 + 1.0f;
+        float4 x2 = x0 + 2.0f;
+        float4 x3 = x0 + 3.0f;
+        float4 x4 = x0 + 4.0f;
+        float4 x5 = x0 + 5.0f;
+        float4 x6 = x0 + 6.0f;
+        float4 x7 = x0 + 7.0f;
+
+        for (int i = 0; i < 64; i++)
+        {
+            x0 = mad(x0, a, b);
+            x1 = mad(x1, a, b);
+            x2 = mad(x2, a, b);
+            x3 = mad(x3, a, b);
+            x4 = mad(x4, a, b);
+            x5 = mad(x5, a, b);
+            x6 = mad(x6, a, b);
+            x7 = mad(x7, a, b);
+        }
+
+        // Keep every chain alive
+        out[get_global_id(0)] = x0 + x1 + x2 + x3 + x4 + x5 + x6 + x7;
+    }
+);
+
+// The queue must have profiling enabled. Takes the best of `runs`
+// launches, a peak is what the device can do, not what it usually does.
+// Throws cl::Error, after printing the build log if the build fails.
+inline Roofline measure_roofline(cl::Context const& context, cl::Device const& device,
+                                 cl::CommandQueue& queue, int runs = 10)
+{
+    constexpr double MadFlops = 64 * 8 * 4 * 2;
+
+    cl::Program program(context, roofline_kernel_source);
+    try
+    {
+        program.build({device});
+    }
+    catch (cl::Error const&)
+    {
+        std::cerr << "BUILD INFO: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+        throw;
+    }
+
+    auto seconds = [&](cl::Kernel& kernel, size_t items)
+    {
+        double best = 0;
+        // First launch is a warm up
+        for (int run = 0; run <= runs; run++)
+        {
+            cl::Event event;
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(items), cl::NullRange, nullptr, &event);
+            event.wait();
+            double time = (event.getProfilingInfo<CL_PROFILING_COMMAND_END>() -
+                           event.getProfilingInfo<CL_PROFILING_COMMAND_START>()) * 1.0e-9;
+            if (run && (best == 0 || time < best))
+                best = time;
+        }
+        return best;
+    };
+
+    Roofline roofline;
+
+    // Large enough to defeat any cache, small enough for every allocation limit
+    size_t bytes = std::min<cl_ulong>(device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>() / 2, 256 << 20);
+    size_t items = bytes / (4 * sizeof(float));
+    cl::Buffer in(context, CL_MEM_READ_ONLY, items * 4 * sizeof(float));
+    cl::Buffer out(context, CL_MEM_WRITE_ONLY, items * 4 * sizeof(float));
+    queue.enqueueFillBuffer(in, 0.0f, 0, items * 4 * sizeof(float));
+
+    cl::Kernel copy(program, "roofline_copy");
+    copy.setArg(0, in);
+    copy.setArg(1, out);
+    roofline.bandwidth = 2.0 * items * 4 * sizeof(float) / seconds(copy, items);
+
+    size_t madItems = 1 << 20;
+    cl::Buffer madOut(context, CL_MEM_WRITE_ONLY, madItems * 4 * sizeof(float));
+    cl::Kernel mad(program, "roofline_mad");
+    mad.setArg(0, madOut);
+    mad.setArg(1, 0.999f);
+    mad.setArg(2, 0.001f);
+    roofline.flops = MadFlops * madItems / seconds(mad, madItems);
+
+    return roofline;
+}
+
+#endif // ROOFLINE_H
@@ -1,8 +1,17 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
 
 #include "opencl.h"
+#include "convolution.h"
+#include "rotational-kernels.h"
+#include "rotational-blur.h"
 
 static constexpr double Epsilon = (1.0e-15);
 static constexpr unsigned PixelSize = 16;
+static constexpr double Pi = 3.14159265358979323846;
 
 template <typename Ptr, typename T>
 inline constexpr bool aligned(Ptr p)
@@ -10,16 +19,1375 @@ inline constexpr bool aligned(Ptr p)
     return bool(size_t(p) & (sizeof(T) - 1));
 }
 
-int rotational_blur(cl::Context& context, float* image, int width, int heigth, const float angle)
+static const std::string rotational_kernel_source = rotational_sampling_source + KERNEL_SOURCE(
+    // `density` samples per pixel of arc length, at most maxSamples
+    int arc_samples(float radius, float angle, float density, int maxSamples)
+    {
+        int samples = max(1, (int)ceil(radius * angle * density));
+        return maxSamples > 0 ? min(samples, maxSamples) : samples;
+    }
+
+    // Average of `samples` samples along the arc through (x, y). `image`
+    // is the input followed by `levels` - 1 pyramid levels, see
+    // rotational_downsample.
+    float4 arc_mean(__global const float4* image,
+                    int width,
+                    int height,
+                    float angle,
+                    int samples,
+                    int levels,
+                    int x,
+                    int y)
+    {
+        // Rotation centre sits between pixels for even sizes so that
+        // the sampling pattern is mirror symmetric
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        // Midpoint rule
+        float step = angle / samples;
+        float start = theta - 0.5f * angle + 0.5f * step;
+
+        // Samples further apart than a pixel read the level whose pixels
+        // are about as large as the sample spacing
+        int level = min(levels - 1, (int)floor(log2(max(radius * step, 1.0f))));
+        int levelWidth = width;
+        int levelHeight = height;
+        for (int k = 0; k < level; k++)
+        {
+            image += levelWidth * levelHeight;
+            levelWidth = (levelWidth + 1) >> 1;
+            levelHeight = (levelHeight + 1) >> 1;
+        }
+        float scale = 1.0f / (1 << level);
+
+        float4 sum = (float4)(0.0f);
+        for (int i = 0; i < samples; i++)
+        {
+            float t = start + i * step;
+            float sx = (cx + radius * cos(t) + 0.5f) * scale - 0.5f;
+            float sy = (cy + radius * sin(t) + 0.5f) * scale - 0.5f;
+            sum += sample_bilinear(image, levelWidth, levelHeight, sx, sy);
+        }
+
+        return sum / (float)samples;
+    }
+
+    // Average along the arc through (x, y), sampled directly
+    float4 arc_direct(__global const float4* image,
+                      int width,
+                      int height,
+                      float angle,
+                      float density,
+                      int maxSamples,
+                      int levels,
+                      int x,
+                      int y)
+    {
+        float dx = x - 0.5f * (width - 1);
+        float dy = y - 0.5f * (height - 1);
+        int samples = arc_samples(sqrt(dx*dx + dy*dy), angle, density, maxSamples);
+        return arc_mean(image, width, height, angle, samples, levels, x, y);
+    }
+
+    // Same average from a precomputed table, see rotational-lut.h. The
+    // pixel is folded into the stored octant or quadrant and the stored
+    // taps are unfolded again, no trigonometry involved.
+    float4 arc_lut(__global const float4* image,
+                   int width,
+                   int height,
+                   __global const uint* tapStart,
+                   __global const short4* taps,
+                   int tableWidth,
+                   int octant,
+                   int x,
+                   int y)
+    {
+        int u = 2*x - (width - 1);
+        int v = 2*y - (height - 1);
+        int mirrorX = u < 0;
+        int mirrorY = v < 0;
+        u = abs(u);
+        v = abs(v);
+
+        int transpose = octant && v > u;
+        int ku = (transpose ? v : u) >> 1;
+        int kv = (transpose ? u : v) >> 1;
+        int index = octant ? ku*(ku + 1)/2 + kv : kv*tableWidth + ku;
+
+        uint first = tapStart[index];
+        uint last = tapStart[index + 1];
+
+        float4 sum = (float4)(0.0f);
+        for (uint i = first; i < last; i++)
+        {
+            short4 tap = taps[i];
+            int u0 = transpose ? tap.y : tap.x;
+            int v0 = transpose ? tap.x : tap.y;
+            float ax = (transpose ? tap.w : tap.z) * (1.0f / 32767.0f);
+            float ay = (transpose ? tap.z : tap.w) * (1.0f / 32767.0f);
+
+            if (mirrorX)
+            {
+                u0 = -u0 - 2;
+                ax = 1.0f - ax;
+            }
+            if (mirrorY)
+            {
+                v0 = -v0 - 2;
+                ay = 1.0f - ay;
+            }
+
+            sum += sample_cell(image, width, height, (u0 + width - 1) >> 1, (v0 + height - 1) >> 1, ax, ay);
+        }
+
+        return sum / (float)(last - first);
+    }
+
+    __kernel void rotational_blur(__global const float4* imageIn,
+                                  __global float4* imageOut,
+                                  int width,
+                                  int height,
+                                  float angle,
+                                  float density,
+                                  int maxSamples,
+                                  int levels)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        imageOut[y*width + x] = arc_direct(imageIn, width, height, angle, density, maxSamples, levels, x, y);
+    }
+
+    __kernel void rotational_blur_lut(__global const float4* imageIn,
+                                      __global float4* imageOut,
+                                      int width,
+                                      int height,
+                                      __global const uint* tapStart,
+                                      __global const short4* taps,
+                                      int tableWidth,
+                                      int octant)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        imageOut[y*width + x] = arc_lut(imageIn, width, height, tapStart, taps, tableWidth, octant, x, y);
+    }
+
+    // Batches of images stacked in imageIn and imageOut, the third
+    // dimension picks the image. Inputs start `inStride` pixels apart,
+    // their pyramid levels included.
+    __kernel void rotational_blur_batch(__global const float4* imageIn,
+                                        __global float4* imageOut,
+                                        int width,
+                                        int height,
+                                        uint inStride,
+                                        float angle,
+                                        float density,
+                                        int maxSamples,
+                                        int levels)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        size_t z = get_global_id(2);
+
+        if (x >= width || y >= height)
+            return;
+
+        imageOut[z*width*height + y*width + x] = arc_direct(imageIn + z*inStride, width, height, angle, density,
+                                                            maxSamples, levels, x, y);
+    }
+
+    __kernel void rotational_blur_lut_batch(__global const float4* imageIn,
+                                            __global float4* imageOut,
+                                            int width,
+                                            int height,
+                                            __global const uint* tapStart,
+                                            __global const short4* taps,
+                                            int tableWidth,
+                                            int octant)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        size_t offset = get_global_id(2) * width * height;
+
+        if (x >= width || y >= height)
+            return;
+
+        imageOut[offset + y*width + x] = arc_lut(imageIn + offset, width, height, tapStart, taps, tableWidth, octant,
+                                                 x, y);
+    }
+
+    // One pyramid level from the previous one, 2x2 box filter. Level k
+    // has ((size of level k-1) + 1) / 2 pixels per axis and starts right
+    // after level k-1 in the same buffer. The third dimension picks one of
+    // several pyramids `stride` pixels apart.
+    __kernel void rotational_downsample(__global float4* pyramid,
+                                        uint inOffset,
+                                        int inWidth,
+                                        int inHeight,
+                                        uint outOffset,
+                                        int outWidth,
+                                        int outHeight,
+                                        uint stride)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= outWidth || y >= outHeight)
+            return;
+
+        pyramid += get_global_id(2) * stride;
+        __global const float4* in = pyramid + inOffset;
+        int x0 = 2*x;
+        int y0 = 2*y;
+        int x1 = min(x0 + 1, inWidth - 1);
+        int y1 = min(y0 + 1, inHeight - 1);
+
+        pyramid[outOffset + y*outWidth + x] = 0.25f * (in[y0*inWidth + x0] + in[y0*inWidth + x1] +
+                                                       in[y1*inWidth + x0] + in[y1*inWidth + x1]);
+    }
+
+    // Tiled layout: 8x8 tiles (TileSize) in row-major tile order, pixels
+    // row-major within a tile, so that the 2x2 cells of an arc mostly
+    // fall into the 1 KiB a tile takes
+    int tiled_index(int x, int y, int tilesX)
+    {
+        return (((y >> 3) * tilesX + (x >> 3)) << 6) + ((y & 7) << 3) + (x & 7);
+    }
+
+    __kernel void rotational_tile(__global const float4* imageIn,
+                                  __global float4* tiled,
+                                  int width,
+                                  int height,
+                                  int tilesX)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        // Padding repeats the edge
+        tiled[tiled_index(x, y, tilesX)] = imageIn[min(y, height - 1)*width + min(x, width - 1)];
+    }
+
+    float4 sample_tiled(__global const float4* image, int width, int height, int tilesX, float x, float y)
+    {
+        float fx = floor(x);
+        float fy = floor(y);
+        float ax = x - fx;
+        float ay = y - fy;
+
+        int x0 = clamp((int)fx, 0, width - 1);
+        int y0 = clamp((int)fy, 0, height - 1);
+        int x1 = clamp((int)fx + 1, 0, width - 1);
+        int y1 = clamp((int)fy + 1, 0, height - 1);
+
+        float4 top = mix(image[tiled_index(x0, y0, tilesX)], image[tiled_index(x1, y0, tilesX)], ax);
+        float4 bottom = mix(image[tiled_index(x0, y1, tilesX)], image[tiled_index(x1, y1, tilesX)], ax);
+        return mix(top, bottom, ay);
+    }
+
+    // One group per 8x8 output tile, groups walk the tiles in the order
+    // of `tileOrder` ((tx | ty << 16), a Hilbert curve) so that groups in
+    // flight at the same time blur neighbouring tiles and share the input
+    // tiles their arcs pass through
+    __kernel void rotational_blur_tiled(__global const float4* tiled,
+                                        __global float4* imageOut,
+                                        int width,
+                                        int height,
+                                        int tilesX,
+                                        float angle,
+                                        float density,
+                                        int maxSamples,
+                                        __global const uint* tileOrder)
+    {
+        uint tile = tileOrder[get_group_id(0)];
+        int x = ((tile & 0xffff) << 3) + (get_local_id(0) & 7);
+        int y = ((tile >> 16) << 3) + (get_local_id(0) >> 3);
+
+        if (x >= width || y >= height)
+            return;
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        int samples = arc_samples(radius, angle, density, maxSamples);
+        float step = angle / samples;
+        float start = theta - 0.5f * angle + 0.5f * step;
+
+        float4 sum = (float4)(0.0f);
+        for (int i = 0; i < samples; i++)
+        {
+            float t = start + i * step;
+            sum += sample_tiled(tiled, width, height, tilesX, cx + radius * cos(t), cy + radius * sin(t));
+        }
+
+        imageOut[y*width + x] = sum / (float)samples;
+    }
+
+    // Shear backend: rotations by three 1D shears (Paeth), x += alpha*y,
+    // y += beta*x, x += alpha*y, with alpha = -tan(t/2) and beta = sin(t).
+    // The first pass shears the input rows into a grid padded by marginX
+    // columns and marginY rows on each side, the second shears its columns
+    // into a grid of the input height, the third shears the rows back into
+    // the output and adds them up. Every pass streams along one axis.
+
+    // Linear interpolation at position u of `count` values `stride` apart,
+    // clamped to the ends
+    float4 shear_lerp(__global const float4* line, int stride, int count, float u)
+    {
+        u = clamp(u, 0.0f, (float)(count - 1));
+        int k0 = (int)u;
+        int k1 = min(k0 + 1, count - 1);
+        return mix(line[k0 * stride], line[k1 * stride], u - k0);
+    }
+
+    // With `flip` the input is read rotated by half a turn, so that
+    // rotations beyond a quarter turn shear by less than one
+    __kernel void shear_input(__global const float4* imageIn,
+                              __global float4* sheared,
+                              int width,
+                              int height,
+                              int marginX,
+                              int marginY,
+                              float alpha,
+                              int flip)
+    {
+        int i = get_global_id(0);
+        int j = get_global_id(1);
+        int shearedWidth = width + 2 * marginX;
+
+        if (i >= shearedWidth || j >= height + 2 * marginY)
+            return;
+
+        float ey = j - marginY - 0.5f * (height - 1);
+        int row = clamp(flip ? height - 1 - j + marginY : j - marginY, 0, height - 1);
+        float u = flip ? width - 1 - i + marginX - alpha * ey : i - marginX + alpha * ey;
+
+        sheared[j*shearedWidth + i] = shear_lerp(imageIn + row*width, 1, width, u);
+    }
+
+    __kernel void shear_columns(__global const float4* sheared,
+                                __global float4* imageOut,
+                                int width,
+                                int height,
+                                int marginX,
+                                int marginY,
+                                float beta)
+    {
+        int i = get_global_id(0);
+        int j = get_global_id(1);
+        int shearedWidth = width + 2 * marginX;
+
+        if (i >= shearedWidth || j >= height)
+            return;
+
+        float fx = i - marginX - 0.5f * (width - 1);
+        imageOut[j*shearedWidth + i] = shear_lerp(sheared + i, shearedWidth, height + 2 * marginY, j + marginY + beta * fx);
+    }
+
+    // Adds `weight` times the rotated input to the output, or stores it
+    // for the first rotation
+    __kernel void shear_accumulate(__global const float4* sheared,
+                                   __global float4* imageOut,
+                                   int width,
+                                   int height,
+                                   int marginX,
+                                   float alpha,
+                                   float weight,
+                                   int first)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        int shearedWidth = width + 2 * marginX;
+        float dy = y - 0.5f * (height - 1);
+        float4 value = weight * shear_lerp(sheared + y*shearedWidth, 1, shearedWidth, x + marginX + alpha * dy);
+
+        imageOut[y*width + x] = first ? value : imageOut[y*width + x] + value;
+    }
+
+    // Sample counts of angle map launches are rounded up to a ladder:
+    // every count below 8, then four steps per octave (at most 25% more
+    // samples), 64 buckets. Must match rotational_bucket_samples().
+    int sample_bucket(int samples)
+    {
+        if (samples < 8)
+            return samples - 1;
+
+        int octave = 31 - clz(samples - 1);
+        int steps = (samples + (1 << (octave - 2)) - 1) >> (octave - 2);
+        if (steps == 8)
+        {
+            octave++;
+            steps = 4;
+        }
+
+        return min(7 + 4*(octave - 3) + steps - 4, 63);
+    }
+
+    // Bucket of every pixel of an angle map plus a histogram of them
+    __kernel void angle_classify(__global const float* angleMap,
+                                 __global uchar* buckets,
+                                 __global uint* counts,
+                                 int width,
+                                 int height,
+                                 float density,
+                                 int maxSamples)
+    {
+        __local uint histogram[64];
+
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+        int lane = get_local_id(1) * get_local_size(0) + get_local_id(0);
+
+        if (lane < 64)
+            histogram[lane] = 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (x < width && y < height)
+        {
+            float dx = x - 0.5f * (width - 1);
+            float dy = y - 0.5f * (height - 1);
+            int samples = arc_samples(sqrt(dx*dx + dy*dy), angleMap[y*width + x], density, maxSamples);
+            int bucket = sample_bucket(samples);
+
+            buckets[y*width + x] = bucket;
+            atomic_inc(&histogram[bucket]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (lane < 64 && histogram[lane])
+            atomic_add(&counts[lane], histogram[lane]);
+    }
+
+    // Pixels (x | y << 16) grouped by bucket, `cursors` starts at the first
+    // slot of every bucket
+    __kernel void angle_scatter(__global const uchar* buckets,
+                                __global uint* cursors,
+                                __global uint* pixels,
+                                int width,
+                                int height)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        pixels[atomic_inc(&cursors[buckets[y*width + x]])] = x | (y << 16);
+    }
+
+    // One bucket: every lane takes the same number of samples
+    __kernel void rotational_blur_angle_map(__global const float4* imageIn,
+                                            __global float4* imageOut,
+                                            __global const float* angleMap,
+                                            __global const uint* pixels,
+                                            int width,
+                                            int height,
+                                            uint first,
+                                            uint count,
+                                            int samples)
+    {
+        uint i = get_global_id(0);
+        if (i >= count)
+            return;
+
+        uint pixel = pixels[first + i];
+        int x = pixel & 0xffff;
+        int y = pixel >> 16;
+
+        imageOut[y*width + x] = arc_mean(imageIn, width, height, angleMap[y*width + x], samples, 1, x, y);
+    }
+
+    // Persistent groups: every group keeps pulling the next chunk of the
+    // band schedule from `next` until the schedule is exhausted. Lanes of
+    // a chunk share (almost) the same sample count.
+    uint next_chunk(__global uint* next, __local uint* chunk)
+    {
+        if (get_local_id(0) == 0)
+            *chunk = atomic_add(next, (uint)get_local_size(0));
+        barrier(CLK_LOCAL_MEM_FENCE);
+        uint start = *chunk;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        return start;
+    }
+
+    __kernel void rotational_blur_bands(__global const float4* imageIn,
+                                        __global float4* imageOut,
+                                        int width,
+                                        int height,
+                                        float angle,
+                                        float density,
+                                        int maxSamples,
+                                        int levels,
+                                        __global const uint* schedule,
+                                        uint count,
+                                        __global uint* next)
+    {
+        __local uint chunk;
+
+        for (uint start = next_chunk(next, &chunk); start < count; start = next_chunk(next, &chunk))
+        {
+            uint i = start + get_local_id(0);
+            if (i < count)
+            {
+                int x = schedule[i] & 0xffff;
+                int y = schedule[i] >> 16;
+                imageOut[y*width + x] = arc_direct(imageIn, width, height, angle, density, maxSamples, levels, x, y);
+            }
+        }
+    }
+
+    __kernel void rotational_blur_lut_bands(__global const float4* imageIn,
+                                            __global float4* imageOut,
+                                            int width,
+                                            int height,
+                                            __global const uint* tapStart,
+                                            __global const short4* taps,
+                                            int tableWidth,
+                                            int octant,
+                                            __global const uint* schedule,
+                                            uint count,
+                                            __global uint* next)
+    {
+        __local uint chunk;
+
+        for (uint start = next_chunk(next, &chunk); start < count; start = next_chunk(next, &chunk))
+        {
+            uint i = start + get_local_id(0);
+            if (i < count)
+            {
+                int x = schedule[i] & 0xffff;
+                int y = schedule[i] >> 16;
+                imageOut[y*width + x] = arc_lut(imageIn, width, height, tapStart, taps, tableWidth, octant, x, y);
+            }
+        }
+    }
+);
+
+// Appended to rotational_kernel_source on devices with image support
+static const std::string rotational_image_kernel_source = KERNEL_SOURCE(
+    // Texture unit does the bilinear blend and the edge clamping
+    __constant sampler_t arcSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+    float4 arc_image(read_only image2d_t image,
+                     int width,
+                     int height,
+                     float angle,
+                     float density,
+                     int maxSamples,
+                     int x,
+                     int y)
+    {
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        int samples = arc_samples(radius, angle, density, maxSamples);
+        float step = angle / samples;
+        float start = theta - 0.5f * angle + 0.5f * step;
+
+        // Texel centres sit at (i + 0.5) / size in normalised coordinates
+        float2 scale = (float2)(1.0f / width, 1.0f / height);
+
+        float4 sum = (float4)(0.0f);
+        for (int i = 0; i < samples; i++)
+        {
+            float t = start + i * step;
+            float2 p = (float2)(cx + radius * cos(t) + 0.5f, cy + radius * sin(t) + 0.5f);
+            sum += read_imagef(image, arcSampler, p * scale);
+        }
+
+        return sum / (float)samples;
+    }
+
+    __kernel void rotational_blur_image(read_only image2d_t imageIn,
+                                        __global float4* imageOut,
+                                        int width,
+                                        int height,
+                                        float angle,
+                                        float density,
+                                        int maxSamples)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        imageOut[y*width + x] = arc_image(imageIn, width, height, angle, density, maxSamples, x, y);
+    }
+
+    __kernel void rotational_blur_image_bands(read_only image2d_t imageIn,
+                                              __global float4* imageOut,
+                                              int width,
+                                              int height,
+                                              float angle,
+                                              float density,
+                                              int maxSamples,
+                                              __global const uint* schedule,
+                                              uint count,
+                                              __global uint* next)
+    {
+        __local uint chunk;
+
+        for (uint start = next_chunk(next, &chunk); start < count; start = next_chunk(next, &chunk))
+        {
+            uint i = start + get_local_id(0);
+            if (i < count)
+            {
+                int x = schedule[i] & 0xffff;
+                int y = schedule[i] >> 16;
+                imageOut[y*width + x] = arc_image(imageIn, width, height, angle, density, maxSamples, x, y);
+            }
+        }
+    }
+);
+
+RotationalBlur::RotationalBlur(cl::Context const& context) :
+    context_ (context),
+    device_ (),
+    queue_ (),
+    program_ (),
+    kernel_ (),
+    lutKernel_ (),
+    bandsKernel_ (),
+    lutBandsKernel_ (),
+    batchKernel_ (),
+    lutBatchKernel_ (),
+    downsampleKernel_ (),
+    imageKernel_ (),
+    imageBandsKernel_ (),
+    classifyKernel_ (),
+    scatterKernel_ (),
+    angleMapKernel_ (),
+    tileKernel_ (),
+    tiledKernel_ (),
+    shearInputKernel_ (),
+    shearColumnsKernel_ (),
+    shearAccumulateKernel_ (),
+    counter_ (),
+    pyramid_ (),
+    pyramidPixels_ (0),
+    image_ (),
+    imageWidth_ (0),
+    imageHeight_ (0),
+    imageSupport_ (false),
+    mapBuckets_ (),
+    mapCounts_ (),
+    mapPixels_ (),
+    mapCapacity_ (0),
+    tiled_ (),
+    tiledPixels_ (0),
+    tileOrder_ (),
+    tilesX_ (0),
+    tilesY_ (0),
+    shearRows_ (),
+    shearColumns_ (),
+    shearPixels_ (0),
+    rotations_ (0),
+    persistentGroups_ (0),
+    scheduling_ (SCHEDULE_BANDS),
+    backend_ (BACKEND_BUFFER),
+    layout_ (LAYOUT_ROWS),
+    lut_ (context),
+    schedules_ (context)
+{
+    auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+    if (devices.empty())
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "RotationalBlur");
+
+    device_ = devices.front();
+    queue_ = cl::CommandQueue(context_, device_);
+
+    // image2d_t kernels do not even build without image support
+    imageSupport_ = device_.getInfo<CL_DEVICE_IMAGE_SUPPORT>();
+    std::string source = rotational_kernel_source;
+    if (imageSupport_)
+        source += rotational_image_kernel_source;
+
+    program_ = cl::Program(context_, source);
+    try
+    {
+        program_.build({device_});
+    }
+    catch (cl::Error const&)
+    {
+        std::cerr << "BUILD INFO: " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+        throw;
+    }
+
+    kernel_ = cl::Kernel(program_, "rotational_blur");
+    lutKernel_ = cl::Kernel(program_, "rotational_blur_lut");
+    bandsKernel_ = cl::Kernel(program_, "rotational_blur_bands");
+    lutBandsKernel_ = cl::Kernel(program_, "rotational_blur_lut_bands");
+    batchKernel_ = cl::Kernel(program_, "rotational_blur_batch");
+    lutBatchKernel_ = cl::Kernel(program_, "rotational_blur_lut_batch");
+    downsampleKernel_ = cl::Kernel(program_, "rotational_downsample");
+    classifyKernel_ = cl::Kernel(program_, "angle_classify");
+    scatterKernel_ = cl::Kernel(program_, "angle_scatter");
+    angleMapKernel_ = cl::Kernel(program_, "rotational_blur_angle_map");
+    tileKernel_ = cl::Kernel(program_, "rotational_tile");
+    tiledKernel_ = cl::Kernel(program_, "rotational_blur_tiled");
+    shearInputKernel_ = cl::Kernel(program_, "shear_input");
+    shearColumnsKernel_ = cl::Kernel(program_, "shear_columns");
+    shearAccumulateKernel_ = cl::Kernel(program_, "shear_accumulate");
+    if (imageSupport_)
+    {
+        imageKernel_ = cl::Kernel(program_, "rotational_blur_image");
+        imageBandsKernel_ = cl::Kernel(program_, "rotational_blur_image_bands");
+    }
+
+    // Enough resident groups to fill every compute unit several times over
+    counter_ = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(cl_uint));
+    mapCounts_ = cl::Buffer(context_, CL_MEM_READ_WRITE, AngleBuckets * sizeof(cl_uint));
+    persistentGroups_ = device_.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * GroupsPerComputeUnit;
+
+    // The banded kernels synchronise every chunk through local memory,
+    // which CPU runtimes emulate at a high cost per barrier
+    if (device_.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)
+        scheduling_ = SCHEDULE_ROWS;
+}
+
+// Pixels of a pyramid of `levels` levels over width x height
+static size_t rotational_pyramid_pixels(int width, int height, int levels)
+{
+    size_t pixels = 0;
+    for (int level = 0, w = width, h = height; level < levels; level++, w = (w + 1) / 2, h = (h + 1) / 2)
+        pixels += size_t(w) * h;
+
+    return pixels;
+}
+
+cl::Buffer const& RotationalBlur::pyramid(cl::CommandQueue& queue,
+                                          cl::Buffer const& devInputImage,
+                                          int width,
+                                          int height,
+                                          int levels,
+                                          int count)
+{
+    size_t stride = rotational_pyramid_pixels(width, height, levels);
+    size_t pixels = stride * count;
+
+    if (pixels > pyramidPixels_)
+    {
+        pyramid_ = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * PixelSize);
+        pyramidPixels_ = pixels;
+    }
+
+    // Level 0 is the input itself
+    size_t imageSize = size_t(width) * height * PixelSize;
+    for (int i = 0; i < count; i++)
+        queue.enqueueCopyBuffer(devInputImage, pyramid_, i * imageSize, i * stride * PixelSize, imageSize);
+
+    cl_uint offset = 0;
+    for (int level = 1; level < levels; level++)
+    {
+        int outWidth = (width + 1) / 2;
+        int outHeight = (height + 1) / 2;
+        cl_uint outOffset = offset + width * height;
+
+        downsampleKernel_.setArg(0, pyramid_);
+        downsampleKernel_.setArg(1, offset);
+        downsampleKernel_.setArg(2, width);
+        downsampleKernel_.setArg(3, height);
+        downsampleKernel_.setArg(4, outOffset);
+        downsampleKernel_.setArg(5, outWidth);
+        downsampleKernel_.setArg(6, outHeight);
+        downsampleKernel_.setArg(7, cl_uint(stride));
+
+        cl::NDRange localSize {WGX, WGY, 1};
+        cl::NDRange globalSize {roundUp(outWidth, WGX), roundUp(outHeight, WGY), size_t(count)};
+        queue.enqueueNDRangeKernel(downsampleKernel_, cl::NullRange, globalSize, localSize);
+
+        offset = outOffset;
+        width = outWidth;
+        height = outHeight;
+    }
+
+    return pyramid_;
+}
+
+void RotationalBlur::enqueue(cl::CommandQueue& queue,
+                             cl::Buffer const& devInputImage,
+                             cl::Buffer& devOutputImage,
+                             int width,
+                             int height,
+                             float angle,
+                             RotationalSampling const& sampling,
+                             cl::Event* event)
+{
+    if (backend_ == BACKEND_SHEAR)
+    {
+        int rotations = rotations_ > 0 ? rotations_ : rotational_shear_rotations(width, height, angle, sampling);
+        std::vector<cl::Event> events;
+        enqueueShear(queue, devInputImage, devOutputImage, width, height, angle, rotations, event ? &events : nullptr);
+        if (event)
+            *event = events.back();
+        return;
+    }
+
+    RotationalGeometry geometry {width, height, angle, sampling};
+    int levels = rotational_lod_levels(geometry);
+
+    if (backend_ == BACKEND_IMAGE && imageSupport_ && levels == 1)
+    {
+        if (width != imageWidth_ || height != imageHeight_)
+        {
+            image_ = cl::Image2D(context_, CL_MEM_READ_ONLY, cl::ImageFormat(CL_RGBA, CL_FLOAT), width, height);
+            imageWidth_ = width;
+            imageHeight_ = height;
+        }
+
+        cl::size_t<3> origin;
+        cl::size_t<3> region;
+        region[0] = width;
+        region[1] = height;
+        region[2] = 1;
+
+        queue.enqueueCopyBufferToImage(devInputImage, image_, 0, origin, region);
+        enqueue(queue, image_, devOutputImage, width, height, angle, sampling, event);
+        return;
+    }
+
+    if (layout_ == LAYOUT_TILED && levels == 1)
+    {
+        enqueueTiled(queue, devInputImage, devOutputImage, width, height, angle, sampling, event);
+        return;
+    }
+
+    // Tables hold full resolution taps only
+    auto table = levels == 1 ? lut_.get(queue, geometry) : nullptr;
+    auto schedule = scheduling_ == SCHEDULE_BANDS ? schedules_.get(queue, geometry) : nullptr;
+
+    auto& kernel = table ? (schedule ? lutBandsKernel_ : lutKernel_)
+                         : (schedule ? bandsKernel_ : kernel_);
+
+    cl_uint arg = 0;
+    kernel.setArg(arg++, levels > 1 ? pyramid(queue, devInputImage, width, height, levels) : devInputImage);
+    kernel.setArg(arg++, devOutputImage);
+    kernel.setArg(arg++, width);
+    kernel.setArg(arg++, height);
+    if (table)
+    {
+        kernel.setArg(arg++, table->tapStart);
+        kernel.setArg(arg++, table->taps);
+        kernel.setArg(arg++, table->tableWidth);
+        kernel.setArg(arg++, int(table->octant));
+    }
+    else
+    {
+        kernel.setArg(arg++, angle);
+        kernel.setArg(arg++, sampling.density);
+        kernel.setArg(arg++, sampling.maxSamples);
+        kernel.setArg(arg++, levels);
+    }
+
+    launch(queue, kernel, arg, schedule, width, height, event);
+}
+
+void RotationalBlur::enqueueBatch(cl::CommandQueue& queue,
+                                  cl::Buffer const& devInputImages,
+                                  cl::Buffer& devOutputImages,
+                                  int width,
+                                  int height,
+                                  int count,
+                                  float angle,
+                                  RotationalSampling const& sampling,
+                                  cl::Event* event)
 {
-    int length = width * heigth;
-    
-    // todo add constant
-    cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * PixelSize, image);
-    
-    float* filteredImage = new float[length];
-    cl::Buffer devInputImage(context, CL_MEM_WRITE_ONLY, length * PixelSize);
-    
-    
-    delete [] filteredImage;
-}
\ No newline at end of file
+    RotationalGeometry geometry {width, height, angle, sampling};
+    int levels = rotational_lod_levels(geometry);
+
+    auto table = levels == 1 ? lut_.get(queue, geometry) : nullptr;
+    auto& kernel = table ? lutBatchKernel_ : batchKernel_;
+
+    cl_uint arg = 0;
+    kernel.setArg(arg++, levels > 1 ? pyramid(queue, devInputImages, width, height, levels, count) : devInputImages);
+    kernel.setArg(arg++, devOutputImages);
+    kernel.setArg(arg++, width);
+    kernel.setArg(arg++, height);
+    if (table)
+    {
+        kernel.setArg(arg++, table->tapStart);
+        kernel.setArg(arg++, table->taps);
+        kernel.setArg(arg++, table->tableWidth);
+        kernel.setArg(arg++, int(table->octant));
+    }
+    else
+    {
+        kernel.setArg(arg++, cl_uint(rotational_pyramid_pixels(width, height, levels)));
+        kernel.setArg(arg++, angle);
+        kernel.setArg(arg++, sampling.density);
+        kernel.setArg(arg++, sampling.maxSamples);
+        kernel.setArg(arg++, levels);
+    }
+
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                               cl::NDRange(roundUp(width, WGX), roundUp(height, WGY), count),
+                               cl::NDRange(WGX, WGY, 1), nullptr, event);
+}
+
+void RotationalBlur::enqueue(cl::CommandQueue& queue,
+                             cl::Image2D const& devInputImage,
+                             cl::Buffer& devOutputImage,
+                             int width,
+                             int height,
+                             float angle,
+                             RotationalSampling const& sampling,
+                             cl::Event* event)
+{
+    if (!imageSupport_)
+        throw cl::Error(CL_INVALID_OPERATION, "RotationalBlur::enqueue");
+
+    RotationalGeometry geometry {width, height, angle, sampling};
+    auto schedule = scheduling_ == SCHEDULE_BANDS ? schedules_.get(queue, geometry) : nullptr;
+    auto& kernel = schedule ? imageBandsKernel_ : imageKernel_;
+
+    cl_uint arg = 0;
+    kernel.setArg(arg++, devInputImage);
+    kernel.setArg(arg++, devOutputImage);
+    kernel.setArg(arg++, width);
+    kernel.setArg(arg++, height);
+    kernel.setArg(arg++, angle);
+    kernel.setArg(arg++, sampling.density);
+    kernel.setArg(arg++, sampling.maxSamples);
+
+    launch(queue, kernel, arg, schedule, width, height, event);
+}
+
+// Shears of one rotation of the shear backend, see shear_input()
+struct RotationalShear
+{
+    float alpha;
+    float beta;
+    bool flip;
+};
+
+static std::vector<RotationalShear> rotational_shears(float angle, int rotations)
+{
+    std::vector<RotationalShear> shears;
+
+    for (int i = 0; i < rotations; i++)
+    {
+        // Midpoint rule over -angle/2 .. angle/2, as the arc samples
+        double t = angle * ((i + 0.5) / rotations - 0.5);
+
+        RotationalShear shear;
+        shear.flip = std::fabs(t) > 0.5 * Pi;
+        if (shear.flip)
+            t -= t > 0 ? Pi : -Pi;
+        shear.alpha = float(-std::tan(0.5 * t));
+        shear.beta = float(std::sin(t));
+        shears.push_back(shear);
+    }
+
+    return shears;
+}
+
+void RotationalBlur::enqueueShear(cl::CommandQueue& queue,
+                                  cl::Buffer const& devInputImage,
+                                  cl::Buffer& devOutputImage,
+                                  int width,
+                                  int height,
+                                  float angle,
+                                  int rotations,
+                                  std::vector<cl::Event>* events)
+{
+    auto launch = [&](cl::Kernel& kernel, int items, int lines)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(roundUp(items, WGX), roundUp(lines, WGY)),
+                                   cl::NDRange(WGX, WGY), nullptr, events ? &event : nullptr);
+        if (events)
+            events->push_back(event);
+    };
+
+    rotations = std::max(1, rotations);
+    auto shears = rotational_shears(angle, rotations);
+
+    // Padding for the largest shears, the same grid serves all rotations
+    double maxAlpha = 0.0;
+    double maxBeta = 0.0;
+    for (auto const& shear : shears)
+    {
+        maxAlpha = std::max(maxAlpha, std::fabs(double(shear.alpha)));
+        maxBeta = std::max(maxBeta, std::fabs(double(shear.beta)));
+    }
+
+    int marginX = int(std::ceil(maxAlpha * 0.5 * (height - 1))) + 1;
+    int shearedWidth = width + 2 * marginX;
+    int marginY = int(std::ceil(maxBeta * 0.5 * (shearedWidth - 1))) + 1;
+    size_t pixels = size_t(shearedWidth) * (height + 2 * marginY);
+
+    if (pixels > shearPixels_)
+    {
+        shearRows_ = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * PixelSize);
+        shearColumns_ = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * PixelSize);
+        shearPixels_ = pixels;
+    }
+
+    shearInputKernel_.setArg(0, devInputImage);
+    shearInputKernel_.setArg(1, shearRows_);
+    shearInputKernel_.setArg(2, width);
+    shearInputKernel_.setArg(3, height);
+    shearInputKernel_.setArg(4, marginX);
+    shearInputKernel_.setArg(5, marginY);
+
+    shearColumnsKernel_.setArg(0, shearRows_);
+    shearColumnsKernel_.setArg(1, shearColumns_);
+    shearColumnsKernel_.setArg(2, width);
+    shearColumnsKernel_.setArg(3, height);
+    shearColumnsKernel_.setArg(4, marginX);
+    shearColumnsKernel_.setArg(5, marginY);
+
+    shearAccumulateKernel_.setArg(0, shearColumns_);
+    shearAccumulateKernel_.setArg(1, devOutputImage);
+    shearAccumulateKernel_.setArg(2, width);
+    shearAccumulateKernel_.setArg(3, height);
+    shearAccumulateKernel_.setArg(4, marginX);
+    shearAccumulateKernel_.setArg(6, 1.0f / rotations);
+
+    for (size_t i = 0; i < shears.size(); i++)
+    {
+        shearInputKernel_.setArg(6, shears[i].alpha);
+        shearInputKernel_.setArg(7, int(shears[i].flip));
+        launch(shearInputKernel_, shearedWidth, height + 2 * marginY);
+
+        shearColumnsKernel_.setArg(6, shears[i].beta);
+        launch(shearColumnsKernel_, shearedWidth, height);
+
+        shearAccumulateKernel_.setArg(5, shears[i].alpha);
+        shearAccumulateKernel_.setArg(7, int(i == 0));
+        launch(shearAccumulateKernel_, width, height);
+    }
+}
+
+// Inverse of sample_bucket() in the kernel source
+static int rotational_bucket_samples(int bucket)
+{
+    if (bucket < 7)
+        return bucket + 1;
+
+    int octave = 3 + (bucket - 7) / 4;
+    int steps = 4 + (bucket - 7) % 4;
+    return steps << (octave - 2);
+}
+
+void RotationalBlur::enqueueAngleMap(cl::CommandQueue& queue,
+                                     cl::Buffer const& devInputImage,
+                                     cl::Buffer& devOutputImage,
+                                     int width,
+                                     int height,
+                                     cl::Buffer const& devAngleMap,
+                                     RotationalSampling const& sampling,
+                                     std::vector<cl::Event>* events)
+{
+    size_t pixels = size_t(width) * height;
+    if (pixels > mapCapacity_)
+    {
+        mapBuckets_ = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * sizeof(cl_uchar));
+        mapPixels_ = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * sizeof(cl_uint));
+        mapCapacity_ = pixels;
+    }
+
+    auto launch = [&](cl::Kernel& kernel, cl::NDRange const& globalSize, cl::NDRange const& localSize)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize, nullptr, events ? &event : nullptr);
+        if (events)
+            events->push_back(event);
+    };
+
+    cl::NDRange localSize {WGX, WGY};
+    cl::NDRange globalSize {roundUp(width, WGX), roundUp(height, WGY)};
+
+    queue.enqueueFillBuffer(mapCounts_, cl_uint(0), 0, AngleBuckets * sizeof(cl_uint));
+
+    classifyKernel_.setArg(0, devAngleMap);
+    classifyKernel_.setArg(1, mapBuckets_);
+    classifyKernel_.setArg(2, mapCounts_);
+    classifyKernel_.setArg(3, width);
+    classifyKernel_.setArg(4, height);
+    classifyKernel_.setArg(5, sampling.density);
+    classifyKernel_.setArg(6, sampling.maxSamples);
+    launch(classifyKernel_, globalSize, localSize);
+
+    // The host needs the bucket sizes to size the launches
+    std::vector<cl_uint> counts(AngleBuckets);
+    std::vector<cl_uint> first(AngleBuckets, 0);
+    queue.enqueueReadBuffer(mapCounts_, CL_TRUE, 0, AngleBuckets * sizeof(cl_uint), counts.data());
+    for (unsigned bucket = 1; bucket < AngleBuckets; bucket++)
+        first[bucket] = first[bucket - 1] + counts[bucket - 1];
+    // Blocking, `first` dies with this call; the read above stalled anyway
+    queue.enqueueWriteBuffer(mapCounts_, CL_TRUE, 0, AngleBuckets * sizeof(cl_uint), first.data());
+
+    scatterKernel_.setArg(0, mapBuckets_);
+    scatterKernel_.setArg(1, mapCounts_);
+    scatterKernel_.setArg(2, mapPixels_);
+    scatterKernel_.setArg(3, width);
+    scatterKernel_.setArg(4, height);
+    launch(scatterKernel_, globalSize, localSize);
+
+    angleMapKernel_.setArg(0, devInputImage);
+    angleMapKernel_.setArg(1, devOutputImage);
+    angleMapKernel_.setArg(2, devAngleMap);
+    angleMapKernel_.setArg(3, mapPixels_);
+    angleMapKernel_.setArg(4, width);
+    angleMapKernel_.setArg(5, height);
+
+    for (unsigned bucket = 0; bucket < AngleBuckets; bucket++)
+    {
+        if (!counts[bucket])
+            continue;
+
+        angleMapKernel_.setArg(6, first[bucket]);
+        angleMapKernel_.setArg(7, counts[bucket]);
+        angleMapKernel_.setArg(8, rotational_bucket_samples(bucket));
+        launch(angleMapKernel_, cl::NDRange(roundUp(counts[bucket], BandGroupSize)), cl::NDRange(BandGroupSize));
+    }
+}
+
+void RotationalBlur::enqueueTiled(cl::CommandQueue& queue,
+                                  cl::Buffer const& devInputImage,
+                                  cl::Buffer& devOutputImage,
+                                  int width,
+                                  int height,
+                                  float angle,
+                                  RotationalSampling const& sampling,
+                                  cl::Event* event)
+{
+    int tilesX = (width + TileSize - 1) / TileSize;
+    int tilesY = (height + TileSize - 1) / TileSize;
+    size_t pixels = size_t(tilesX) * tilesY * TileSize * TileSize;
+
+    if (pixels > tiledPixels_)
+    {
+        tiled_ = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * PixelSize);
+        tiledPixels_ = pixels;
+    }
+
+    if (tilesX != tilesX_ || tilesY != tilesY_)
+    {
+        auto order = build_hilbert_tile_order(tilesX, tilesY);
+        tileOrder_ = cl::Buffer(context_, CL_MEM_READ_ONLY, order.size() * sizeof(cl_uint));
+        queue.enqueueWriteBuffer(tileOrder_, CL_TRUE, 0, order.size() * sizeof(cl_uint), order.data());
+        tilesX_ = tilesX;
+        tilesY_ = tilesY;
+    }
+
+    tileKernel_.setArg(0, devInputImage);
+    tileKernel_.setArg(1, tiled_);
+    tileKernel_.setArg(2, width);
+    tileKernel_.setArg(3, height);
+    tileKernel_.setArg(4, tilesX);
+    queue.enqueueNDRangeKernel(tileKernel_, cl::NullRange, cl::NDRange(tilesX * TileSize, tilesY * TileSize),
+                               cl::NDRange(TileSize, TileSize));
+
+    tiledKernel_.setArg(0, tiled_);
+    tiledKernel_.setArg(1, devOutputImage);
+    tiledKernel_.setArg(2, width);
+    tiledKernel_.setArg(3, height);
+    tiledKernel_.setArg(4, tilesX);
+    tiledKernel_.setArg(5, angle);
+    tiledKernel_.setArg(6, sampling.density);
+    tiledKernel_.setArg(7, sampling.maxSamples);
+    tiledKernel_.setArg(8, tileOrder_);
+    queue.enqueueNDRangeKernel(tiledKernel_, cl::NullRange, cl::NDRange(size_t(tilesX) * tilesY * TileSize * TileSize),
+                               cl::NDRange(TileSize * TileSize), nullptr, event);
+}
+
+void RotationalBlur::launch(cl::CommandQueue& queue,
+                            cl::Kernel& kernel,
+                            cl_uint arg,
+                            RotationalScheduleCache::Entry const* schedule,
+                            int width,
+                            int height,
+                            cl::Event* event)
+{
+    if (schedule)
+    {
+        kernel.setArg(arg++, schedule->pixels);
+        kernel.setArg(arg++, schedule->count);
+        kernel.setArg(arg++, counter_);
+
+        size_t chunks = (schedule->count + BandGroupSize - 1) / BandGroupSize;
+        size_t groups = std::min<size_t>(persistentGroups_, chunks);
+
+        queue.enqueueFillBuffer(counter_, cl_uint(0), 0, sizeof(cl_uint));
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groups * BandGroupSize),
+                                   cl::NDRange(BandGroupSize), nullptr, event);
+        return;
+    }
+
+    cl::NDRange localSize {WGX, WGY};
+    cl::NDRange globalSize {roundUp(width, WGX), roundUp(height, WGY)};
+
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize, nullptr, event);
+}
+
+int rotational_lod_levels(RotationalGeometry const& geometry)
+{
+    auto const& sampling = geometry.sampling;
+    if (!sampling.lod)
+        return 1;
+
+    // Upper bound of the sample spacing: below the cap samples are at most
+    // 1/density apart, capped arcs are longest in the corners
+    float cx = 0.5f * (geometry.width - 1);
+    float cy = 0.5f * (geometry.height - 1);
+    float spacing = 1.0f / sampling.density;
+    if (sampling.maxSamples > 0)
+        spacing = std::max(spacing, std::sqrt(cx*cx + cy*cy) * geometry.angle / sampling.maxSamples);
+
+    int levels = 1 + int(std::floor(std::log2(std::max(spacing, 1.0f))));
+
+    // No level below 1x1
+    int available = 1;
+    for (int w = geometry.width, h = geometry.height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2)
+        available++;
+
+    return std::min(levels, available);
+}
+
+double rotational_blur_samples(int width, int height, float angle, RotationalSampling const& sampling)
+{
+    float cx = 0.5f * (width - 1);
+    float cy = 0.5f * (height - 1);
+    double total = 0;
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float dx = x - cx;
+            float dy = y - cy;
+            total += rotational_arc_samples(std::sqrt(dx*dx + dy*dy), angle, sampling);
+        }
+    }
+
+    return total;
+}
+
+int rotational_shear_rotations(int width, int height, float angle, RotationalSampling const& sampling)
+{
+    float cx = 0.5f * (width - 1);
+    float cy = 0.5f * (height - 1);
+    return rotational_arc_samples(std::sqrt(cx*cx + cy*cy), angle, sampling);
+}
+
+// One engine per context for the whole run of the program, so that the
+// sampling tables cached in it survive between calls
+static RotationalBlur& rotational_engine(cl::Context const& context)
+{
+    static std::map<cl_context, std::unique_ptr<RotationalBlur>> engines;
+
+    auto& engine = engines[context()];
+    if (!engine)
+        engine.reset(new RotationalBlur(context));
+
+    return *engine;
+}
+
+RotationalSampling rotational_sampling(RotationalQuality quality)
+{
+    RotationalSampling sampling;
+
+    switch (quality)
+    {
+    case QUALITY_PREVIEW:
+        sampling.density = 0.25f;
+        sampling.maxSamples = 16;
+        sampling.lod = true;
+        break;
+    case QUALITY_DRAFT:
+        sampling.density = 0.5f;
+        sampling.maxSamples = 64;
+        sampling.lod = true;
+        break;
+    case QUALITY_FINAL:
+        break;
+    }
+
+    return sampling;
+}
+
+int rotational_blur(cl::Context& context, float* image, int width, int height, const float angle,
+                    RotationalQuality quality)
+{
+    int ret = CL_SUCCESS;
+
+    try
+    {
+        int length = width * height;
+
+        auto& blur = rotational_engine(context);
+        auto queue = blur.queue();
+
+        cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * PixelSize, image);
+        cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, length * PixelSize);
+
+        blur.enqueue(queue, devInputImage, devOutputImage, width, height, angle, rotational_sampling(quality));
+        queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, length * PixelSize, image);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        ret = err.err();
+    }
+
+    return ret;
+}
+
+int rotational_blur(cl::Context& context, float* image, int width, int height, float const* angleMap,
+                    RotationalQuality quality)
+{
+    int ret = CL_SUCCESS;
+
+    try
+    {
+        int length = width * height;
+
+        auto& blur = rotational_engine(context);
+        auto queue = blur.queue();
+
+        cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * PixelSize, image);
+        cl::Buffer devAngleMap(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * sizeof(float),
+                               const_cast<float*>(angleMap));
+        cl::Buffer devOutputImage(context, CL_MEM_WRITE_ONLY, length * PixelSize);
+
+        blur.enqueueAngleMap(queue, devInputImage, devOutputImage, width, height, devAngleMap,
+                             rotational_sampling(quality));
+        queue.enqueueReadBuffer(devOutputImage, CL_TRUE, 0, length * PixelSize, image);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        ret = err.err();
+    }
+
+    return ret;
+}
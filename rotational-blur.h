@@ -0,0 +1,310 @@
+#ifndef ROTATIONAL_BLUR_H
+#define ROTATIONAL_BLUR_H
+
+#include <vector>
+
+#include "opencl.h"
+#include "rotational-lut.h"
+#include "rotational-schedule.h"
+
+// Speed/quality trade-off of rotational_blur(). Lower levels take fewer
+// samples along long arcs and cap the samples per arc, the preview level
+// typically runs several times faster than the final one. Both sample a
+// mip pyramid so that skipping pixels does not alias.
+enum RotationalQuality
+{
+    QUALITY_PREVIEW,    // 1 sample per 4 pixels of arc, at most 16, LOD
+    QUALITY_DRAFT,      // 1 sample per 2 pixels of arc, at most 64, LOD
+    QUALITY_FINAL,      // 1 sample per pixel of arc, no limit
+};
+
+RotationalSampling rotational_sampling(RotationalQuality quality);
+
+// Where the kernels read the input from
+enum RotationalBackend
+{
+    // Global memory buffer, bilinear filtering and edge clamping in code
+    BACKEND_BUFFER,
+    // Image object sampled with CLK_FILTER_LINEAR through the texture
+    // cache. Filter weights are only 8 bit on most hardware. Devices
+    // without image support and LOD sampling use buffers.
+    BACKEND_IMAGE,
+    // Average of rotated copies of the whole input, each rotated by three
+    // 1D shears that stream rows and columns (see enqueueShear()). Every
+    // pixel gets the same number of samples, RotationalSampling only sets
+    // that number unless RotationalBlur::setRotations() does.
+    BACKEND_SHEAR,
+};
+
+// Memory layout the buffer kernels sample the input in
+enum RotationalLayout
+{
+    LAYOUT_ROWS,
+    // Input converted to 8x8 pixel tiles first, output tiles blurred in
+    // Hilbert curve order. Takes precedence over tables and scheduling,
+    // not used for LOD or image launches.
+    LAYOUT_TILED,
+};
+
+// Spin blur around the image centre. Images are interleaved float4
+// (RGBA) pixels; every output pixel is the average of the input along
+// the arc of `angle` radians through it, centred on the pixel itself.
+//
+// Sampling tables are cached per geometry (see rotational-lut.h), a
+// geometry seen before skips all trigonometry. Geometries whose table
+// does not fit into the cache budget are sampled directly.
+//
+// Work is scheduled by rings of equal sample count by default on GPUs and
+// by rows on CPU devices, see RotationalScheduling.
+//
+// With RotationalSampling::lod a pyramid of 2x2 box filtered levels is
+// built from the input on every launch and each arc reads the level
+// matching its sample spacing; such launches never use the tables.
+struct RotationalBlur
+{
+    RotationalBlur(cl::Context const& context);
+
+    // Blurs width x height pixels of devInputImage into devOutputImage.
+    // Both buffers must already live on the engine's device.
+    void enqueue(cl::CommandQueue& queue,
+                 cl::Buffer const& devInputImage,
+                 cl::Buffer& devOutputImage,
+                 int width,
+                 int height,
+                 float angle,
+                 RotationalSampling const& sampling = RotationalSampling(),
+                 cl::Event* event = nullptr);
+
+    // Same from an image object (CL_RGBA, CL_FLOAT) whatever the backend.
+    // Throws if the device has no image support, `sampling.lod` is ignored.
+    void enqueue(cl::CommandQueue& queue,
+                 cl::Image2D const& devInputImage,
+                 cl::Buffer& devOutputImage,
+                 int width,
+                 int height,
+                 float angle,
+                 RotationalSampling const& sampling = RotationalSampling(),
+                 cl::Event* event = nullptr);
+
+    // Blurs `count` images of width x height pixels stacked in
+    // devInputImages into devOutputImages, all by the same angle, in one
+    // launch whose third dimension picks the image. Samples the input
+    // directly or through a table whatever the backend, layout and
+    // scheduling.
+    void enqueueBatch(cl::CommandQueue& queue,
+                      cl::Buffer const& devInputImages,
+                      cl::Buffer& devOutputImages,
+                      int width,
+                      int height,
+                      int count,
+                      float angle,
+                      RotationalSampling const& sampling = RotationalSampling(),
+                      cl::Event* event = nullptr);
+
+    // Blurs every pixel by its own angle from devAngleMap (one float per
+    // pixel). Pixels are grouped into buckets of equal sample count on
+    // the device and every bucket is blurred by its own launch in which
+    // all lanes take the same number of samples, rounded up by at most
+    // 25%. Waits for the bucket sizes, samples the input directly
+    // (`sampling.lod` is ignored) and appends the events of all launches
+    // to `events` if given.
+    void enqueueAngleMap(cl::CommandQueue& queue,
+                         cl::Buffer const& devInputImage,
+                         cl::Buffer& devOutputImage,
+                         int width,
+                         int height,
+                         cl::Buffer const& devAngleMap,
+                         RotationalSampling const& sampling = RotationalSampling(),
+                         std::vector<cl::Event>* events = nullptr);
+
+    // Blurs by the mean of `rotations` copies of devInputImage rotated by
+    // angles spread evenly over the arc, midpoint rule as the arc sampling.
+    // Each rotation is three launches (Paeth's shear decomposition), the
+    // last one adding the copy to devOutputImage; their events are appended
+    // to `events` if given.
+    void enqueueShear(cl::CommandQueue& queue,
+                      cl::Buffer const& devInputImage,
+                      cl::Buffer& devOutputImage,
+                      int width,
+                      int height,
+                      float angle,
+                      int rotations,
+                      std::vector<cl::Event>* events = nullptr);
+
+    cl::Context context() const
+    {
+        return context_;
+    }
+
+    cl::Device device() const
+    {
+        return device_;
+    }
+
+    // In-order queue for callers that do not bring their own
+    cl::CommandQueue queue() const
+    {
+        return queue_;
+    }
+
+    RotationalLutCache& lut()
+    {
+        return lut_;
+    }
+
+    void setScheduling(RotationalScheduling scheduling)
+    {
+        scheduling_ = scheduling;
+    }
+
+    RotationalScheduling scheduling() const
+    {
+        return scheduling_;
+    }
+
+    void setBackend(RotationalBackend backend)
+    {
+        backend_ = backend;
+    }
+
+    RotationalBackend backend() const
+    {
+        return backend_;
+    }
+
+    bool imageSupport() const
+    {
+        return imageSupport_;
+    }
+
+    void setLayout(RotationalLayout layout)
+    {
+        layout_ = layout;
+    }
+
+    RotationalLayout layout() const
+    {
+        return layout_;
+    }
+
+    // Rotations of BACKEND_SHEAR, 0 for as many as the sampling takes
+    // along the longest arc. The event enqueue() returns for this backend
+    // is that of its last launch.
+    void setRotations(int rotations)
+    {
+        rotations_ = rotations;
+    }
+
+    int rotations() const
+    {
+        return rotations_;
+    }
+
+private:
+    static constexpr unsigned GroupsPerComputeUnit = 16;
+    // Must match tiled_index() in the kernel source
+    static constexpr int TileSize = 8;
+    // Must match sample_bucket() in the kernel source
+    static constexpr unsigned AngleBuckets = 64;
+
+    // Input followed by levels - 1 downsampled levels, for each of
+    // `count` stacked inputs
+    cl::Buffer const& pyramid(cl::CommandQueue& queue,
+                              cl::Buffer const& devInputImage,
+                              int width,
+                              int height,
+                              int levels,
+                              int count = 1);
+
+    void enqueueTiled(cl::CommandQueue& queue,
+                      cl::Buffer const& devInputImage,
+                      cl::Buffer& devOutputImage,
+                      int width,
+                      int height,
+                      float angle,
+                      RotationalSampling const& sampling,
+                      cl::Event* event);
+
+    // Sets the schedule arguments from `arg` on and launches over the
+    // schedule or over all pixels
+    void launch(cl::CommandQueue& queue,
+                cl::Kernel& kernel,
+                cl_uint arg,
+                RotationalScheduleCache::Entry const* schedule,
+                int width,
+                int height,
+                cl::Event* event);
+
+    cl::Context context_;
+    cl::Device device_;
+    cl::CommandQueue queue_;
+    cl::Program program_;
+    cl::Kernel kernel_;
+    cl::Kernel lutKernel_;
+    cl::Kernel bandsKernel_;
+    cl::Kernel lutBandsKernel_;
+    cl::Kernel batchKernel_;
+    cl::Kernel lutBatchKernel_;
+    cl::Kernel downsampleKernel_;
+    cl::Kernel imageKernel_;
+    cl::Kernel imageBandsKernel_;
+    cl::Kernel classifyKernel_;
+    cl::Kernel scatterKernel_;
+    cl::Kernel angleMapKernel_;
+    cl::Kernel tileKernel_;
+    cl::Kernel tiledKernel_;
+    cl::Kernel shearInputKernel_;
+    cl::Kernel shearColumnsKernel_;
+    cl::Kernel shearAccumulateKernel_;
+    cl::Buffer counter_;            // chunk counter of the banded kernels
+    cl::Buffer pyramid_;
+    size_t pyramidPixels_;
+    cl::Image2D image_;             // input staged for BACKEND_IMAGE
+    int imageWidth_;
+    int imageHeight_;
+    bool imageSupport_;
+    cl::Buffer mapBuckets_;         // bucket of every pixel of an angle map
+    cl::Buffer mapCounts_;          // bucket sizes, then scatter cursors
+    cl::Buffer mapPixels_;          // pixels grouped by bucket
+    size_t mapCapacity_;
+    cl::Buffer tiled_;              // input converted for LAYOUT_TILED
+    size_t tiledPixels_;
+    cl::Buffer tileOrder_;
+    int tilesX_;
+    int tilesY_;
+    cl::Buffer shearRows_;          // input rows sheared, BACKEND_SHEAR
+    cl::Buffer shearColumns_;       // then its columns
+    size_t shearPixels_;
+    int rotations_;
+    size_t persistentGroups_;
+    RotationalScheduling scheduling_;
+    RotationalBackend backend_;
+    RotationalLayout layout_;
+    RotationalLutCache lut_;
+    RotationalScheduleCache schedules_;
+};
+
+// Number of pyramid levels (input included) a launch with `geometry`
+// samples from, 1 without LOD
+int rotational_lod_levels(RotationalGeometry const& geometry);
+
+// Rotated copies BACKEND_SHEAR averages without setRotations(): the
+// samples of the longest arc
+int rotational_shear_rotations(int width, int height, float angle,
+                               RotationalSampling const& sampling = RotationalSampling());
+
+// Total number of bilinear taps the kernel takes for an image, used to
+// count the work of a launch
+double rotational_blur_samples(int width, int height, float angle,
+                               RotationalSampling const& sampling = RotationalSampling());
+
+// Blurs `image` in place. Returns CL_SUCCESS or the OpenCL error code.
+int rotational_blur(cl::Context& context, float* image, int width, int height, const float angle,
+                    RotationalQuality quality = QUALITY_FINAL);
+
+// Same with a blur angle per pixel, `angleMap` holds width x height
+// angles in radians
+int rotational_blur(cl::Context& context, float* image, int width, int height, float const* angleMap,
+                    RotationalQuality quality = QUALITY_FINAL);
+
+#endif // ROTATIONAL_BLUR_H
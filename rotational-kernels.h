@@ -0,0 +1,32 @@
+#ifndef ROTATIONAL_KERNELS_H
+#define ROTATIONAL_KERNELS_H
+
+#include <string>
+
+#include "opencl.h"
+
+// Kernel helpers shared by the programs of the rotational blur engines
+static const std::string rotational_sampling_source = KERNEL_SOURCE(
+    // Bilinear blend of the 2x2 cell with top left pixel (x0, y0),
+    // clamp to edge addressing
+    float4 sample_cell(__global const float4* image, int width, int height, int x0, int y0, float ax, float ay)
+    {
+        int x1 = clamp(x0 + 1, 0, width - 1);
+        int y1 = clamp(y0 + 1, 0, height - 1);
+        x0 = clamp(x0, 0, width - 1);
+        y0 = clamp(y0, 0, height - 1);
+
+        float4 top = mix(image[y0*width + x0], image[y0*width + x1], ax);
+        float4 bottom = mix(image[y1*width + x0], image[y1*width + x1], ax);
+        return mix(top, bottom, ay);
+    }
+
+    float4 sample_bilinear(__global const float4* image, int width, int height, float x, float y)
+    {
+        float fx = floor(x);
+        float fy = floor(y);
+        return sample_cell(image, width, height, (int)fx, (int)fy, x - fx, y - fy);
+    }
+);
+
+#endif // ROTATIONAL_KERNELS_H
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+
+#include "rotational-lut.h"
+
+static constexpr float WeightScale = 32767.0f;
+
+// Lattice of stored pixels, see RotationalLut
+struct LutLayout
+{
+    int parityU;    // u of every pixel is parityU + 2*k
+    int parityV;
+    int countU;     // stored k values per axis
+    int countV;
+    bool octant;
+
+    LutLayout(RotationalGeometry const& geometry) :
+        parityU ((geometry.width - 1) & 1),
+        parityV ((geometry.height - 1) & 1),
+        countU ((geometry.width + 1) / 2),
+        countV ((geometry.height + 1) / 2),
+        octant (parityU == parityV)
+    {
+        if (octant)
+        {
+            countU = std::max(countU, countV);
+            countV = countU;
+        }
+    }
+
+    size_t pixels() const
+    {
+        return octant ? size_t(countU) * (countU + 1) / 2 : size_t(countU) * countV;
+    }
+
+    // Calls f(ku, kv) in storage order
+    template <typename F>
+    void each(F f) const
+    {
+        if (octant)
+        {
+            // Triangle, index ku*(ku+1)/2 + kv with kv <= ku
+            for (int ku = 0; ku < countU; ku++)
+                for (int kv = 0; kv <= ku; kv++)
+                    f(ku, kv);
+        }
+        else
+        {
+            // Quadrant, index kv*countU + ku
+            for (int kv = 0; kv < countV; kv++)
+                for (int ku = 0; ku < countU; ku++)
+                    f(ku, kv);
+        }
+    }
+};
+
+size_t rotational_lut_bytes(RotationalGeometry const& geometry)
+{
+    LutLayout layout(geometry);
+    size_t taps = 0;
+
+    layout.each([&](int ku, int kv)
+    {
+        float dx = 0.5f * (layout.parityU + 2*ku);
+        float dy = 0.5f * (layout.parityV + 2*kv);
+        taps += rotational_arc_samples(std::sqrt(dx*dx + dy*dy), geometry.angle, geometry.sampling);
+    });
+
+    return (layout.pixels() + 1) * sizeof(cl_uint) + taps * 4 * sizeof(cl_short);
+}
+
+RotationalLut build_rotational_lut(RotationalGeometry const& geometry)
+{
+    LutLayout layout(geometry);
+
+    RotationalLut lut;
+    lut.geometry = geometry;
+    lut.octant = layout.octant;
+    lut.tableWidth = layout.countU;
+    lut.tapStart.reserve(layout.pixels() + 1);
+
+    // Along even sizes the centre lies half a pixel off the pixel grid
+    double halfU = 0.5 * layout.parityU;
+    double halfV = 0.5 * layout.parityV;
+
+    layout.each([&](int ku, int kv)
+    {
+        lut.tapStart.push_back(cl_uint(lut.taps.size() / 4));
+
+        float dx = 0.5f * (layout.parityU + 2*ku);
+        float dy = 0.5f * (layout.parityV + 2*kv);
+        float radius = std::sqrt(dx*dx + dy*dy);
+        double theta = std::atan2(double(dy), double(dx));
+
+        int samples = rotational_arc_samples(radius, geometry.angle, geometry.sampling);
+        double step = double(geometry.angle) / samples;
+        double start = theta - 0.5 * geometry.angle + 0.5 * step;
+
+        for (int i = 0; i < samples; i++)
+        {
+            double t = start + i * step;
+            double sx = radius * std::cos(t) + halfU;
+            double sy = radius * std::sin(t) + halfV;
+            double fx = std::floor(sx);
+            double fy = std::floor(sy);
+
+            lut.taps.push_back(cl_short(2 * fx - layout.parityU));
+            lut.taps.push_back(cl_short(2 * fy - layout.parityV));
+            lut.taps.push_back(cl_short(std::lround((sx - fx) * WeightScale)));
+            lut.taps.push_back(cl_short(std::lround((sy - fy) * WeightScale)));
+        }
+    });
+
+    lut.tapStart.push_back(cl_uint(lut.taps.size() / 4));
+    return lut;
+}
+
+RotationalLutCache::Entry const* RotationalLutCache::get(cl::CommandQueue& queue, RotationalGeometry const& geometry)
+{
+    auto found = cache_.find(geometry);
+    if (found)
+        return found;
+
+    // Doubled offsets are stored as shorts
+    if (std::max(geometry.width, geometry.height) >= 16384)
+        return nullptr;
+
+    size_t bytes = rotational_lut_bytes(geometry);
+    if (bytes > cache_.budget())
+        return nullptr;
+
+    auto lut = build_rotational_lut(geometry);
+
+    Entry entry;
+    entry.octant = lut.octant;
+    entry.tableWidth = lut.tableWidth;
+    entry.tapStart = cl::Buffer(context_, CL_MEM_READ_ONLY, lut.tapStart.size() * sizeof(cl_uint));
+    entry.taps = cl::Buffer(context_, CL_MEM_READ_ONLY, lut.taps.size() * sizeof(cl_short));
+    queue.enqueueWriteBuffer(entry.tapStart, CL_TRUE, 0, lut.tapStart.size() * sizeof(cl_uint), lut.tapStart.data());
+    queue.enqueueWriteBuffer(entry.taps, CL_TRUE, 0, lut.taps.size() * sizeof(cl_short), lut.taps.data());
+
+    return cache_.insert(geometry, entry, lut.bytes());
+}
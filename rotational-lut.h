@@ -0,0 +1,136 @@
+#ifndef ROTATIONAL_LUT_H
+#define ROTATIONAL_LUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "opencl.h"
+#include "lru-cache.h"
+
+// How densely arcs are sampled: `density` samples per pixel of arc
+// length, at most `maxSamples` per arc (no limit if 0). With `lod`,
+// samples further apart than a pixel are taken from a downsampled level
+// of the input instead of skipping over it.
+struct RotationalSampling
+{
+    float density = 1.0f;
+    int maxSamples = 0;
+    bool lod = false;
+
+    bool operator<(RotationalSampling const& other) const
+    {
+        if (density != other.density)
+            return density < other.density;
+        if (maxSamples != other.maxSamples)
+            return maxSamples < other.maxSamples;
+        return lod < other.lod;
+    }
+};
+
+// Samples of the arc of `angle` radians at `radius`. Same float
+// expression as the kernel so that host tables agree with it.
+inline int rotational_arc_samples(float radius, float angle, RotationalSampling const& sampling)
+{
+    int samples = std::max(1, int(std::ceil(radius * angle * sampling.density)));
+    if (sampling.maxSamples > 0)
+        samples = std::min(samples, sampling.maxSamples);
+    return samples;
+}
+
+// Everything the arc sampling pattern depends on. The rotation centre is
+// always the image centre.
+struct RotationalGeometry
+{
+    int width;
+    int height;
+    float angle;
+    RotationalSampling sampling;
+
+    bool operator<(RotationalGeometry const& other) const
+    {
+        if (width != other.width)
+            return width < other.width;
+        if (height != other.height)
+            return height < other.height;
+        if (angle != other.angle)
+            return angle < other.angle;
+        return sampling < other.sampling;
+    }
+};
+
+// Precomputed taps of the rotational blur for one geometry.
+//
+// Pixels are addressed by their doubled offset from the centre,
+// u = 2*x - (width-1), v = 2*y - (height-1), which is an integer and
+// flips sign under mirroring. Only pixels with u, v >= 0 are stored
+// (4-fold symmetry), and only v <= u when width and height have the same
+// parity so that transposing maps pixels onto pixels (8-fold symmetry).
+//
+// A tap is the bilinear cell of one sample: the doubled offset of its top
+// left pixel and the x/y fractions scaled to 0..32767. Mirroring a tap in
+// x maps u0 to -u0-2 and ax to 1-ax, transposing swaps x and y.
+struct RotationalLut
+{
+    RotationalGeometry geometry;
+    bool octant;                    // 8-fold (true) or 4-fold table
+    int tableWidth;                 // stored pixels per lattice row (4-fold)
+    std::vector<cl_uint> tapStart;  // first tap of each stored pixel, plus end
+    std::vector<cl_short> taps;     // u0, v0, ax, ay per tap
+
+    size_t bytes() const
+    {
+        return tapStart.size() * sizeof(cl_uint) + taps.size() * sizeof(cl_short);
+    }
+};
+
+// Size in bytes build_rotational_lut() would produce, without building it
+size_t rotational_lut_bytes(RotationalGeometry const& geometry);
+
+RotationalLut build_rotational_lut(RotationalGeometry const& geometry);
+
+// Device copies of the tables, least recently used evicted first once
+// the byte budget is exceeded
+struct RotationalLutCache
+{
+    struct Entry
+    {
+        cl::Buffer tapStart;
+        cl::Buffer taps;
+        bool octant;
+        int tableWidth;
+    };
+
+    static constexpr size_t DefaultBudget = 128 << 20;
+
+    RotationalLutCache(cl::Context const& context, size_t budget = DefaultBudget) :
+        context_ (context),
+        cache_ (budget)
+    {
+    }
+
+    // Returns the table for `geometry`, building and uploading it on a
+    // miss, or nullptr if it does not fit into the budget
+    Entry const* get(cl::CommandQueue& queue, RotationalGeometry const& geometry);
+
+    void setBudget(size_t budget)
+    {
+        cache_.setBudget(budget);
+    }
+
+    size_t budget() const
+    {
+        return cache_.budget();
+    }
+
+    size_t used() const
+    {
+        return cache_.used();
+    }
+
+private:
+    cl::Context context_;
+    LruCache<RotationalGeometry, Entry> cache_;
+};
+
+#endif // ROTATIONAL_LUT_H
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cmath>
+
+#include "rotational-schedule.h"
+
+std::vector<cl_uint> build_band_schedule(RotationalGeometry const& geometry)
+{
+    struct Pixel
+    {
+        int samples;
+        float theta;
+        cl_uint packed;
+    };
+
+    int width = geometry.width;
+    int height = geometry.height;
+    float cx = 0.5f * (width - 1);
+    float cy = 0.5f * (height - 1);
+
+    std::vector<Pixel> pixels;
+    pixels.reserve(width * height);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float dx = x - cx;
+            float dy = y - cy;
+            int samples = rotational_arc_samples(std::sqrt(dx*dx + dy*dy), geometry.angle, geometry.sampling);
+            pixels.push_back({samples, std::atan2(dy, dx), cl_uint(x) | (cl_uint(y) << 16)});
+        }
+    }
+
+    // Longest-processing-time first: the last chunks handed out are the
+    // cheap ones, which keeps the tail short
+    std::sort(pixels.begin(), pixels.end(), [](Pixel const& a, Pixel const& b)
+    {
+        if (a.samples != b.samples)
+            return a.samples > b.samples;
+        return a.theta < b.theta;
+    });
+
+    std::vector<cl_uint> schedule;
+    schedule.reserve(pixels.size());
+    for (auto const& pixel : pixels)
+        schedule.push_back(pixel.packed);
+
+    return schedule;
+}
+
+// Point `d` of the Hilbert curve through an n x n square, n a power of two
+static void hilbert_point(int n, unsigned d, int& x, int& y)
+{
+    x = 0;
+    y = 0;
+
+    for (int s = 1; s < n; s *= 2)
+    {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+
+        // Rotate the quadrant so that sub-curves join up
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+std::vector<cl_uint> build_hilbert_tile_order(int tilesX, int tilesY)
+{
+    int n = 1;
+    while (n < std::max(tilesX, tilesY))
+        n *= 2;
+
+    std::vector<cl_uint> order;
+    order.reserve(size_t(tilesX) * tilesY);
+
+    for (unsigned d = 0; d < unsigned(n) * n; d++)
+    {
+        int x;
+        int y;
+        hilbert_point(n, d, x, y);
+        if (x < tilesX && y < tilesY)
+            order.push_back(cl_uint(x) | (cl_uint(y) << 16));
+    }
+
+    return order;
+}
+
+RotationalScheduleCache::Entry const* RotationalScheduleCache::get(cl::CommandQueue& queue, RotationalGeometry const& geometry)
+{
+    auto found = cache_.find(geometry);
+    if (found)
+        return found;
+
+    // Coordinates are packed into 16 bits each
+    if (std::max(geometry.width, geometry.height) > 65536)
+        return nullptr;
+
+    size_t bytes = size_t(geometry.width) * geometry.height * sizeof(cl_uint);
+    if (bytes > cache_.budget())
+        return nullptr;
+
+    auto schedule = build_band_schedule(geometry);
+
+    Entry entry;
+    entry.count = cl_uint(schedule.size());
+    entry.pixels = cl::Buffer(context_, CL_MEM_READ_ONLY, bytes);
+    queue.enqueueWriteBuffer(entry.pixels, CL_TRUE, 0, bytes, schedule.data());
+
+    return cache_.insert(geometry, entry, bytes);
+}
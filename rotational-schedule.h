@@ -0,0 +1,63 @@
+#ifndef ROTATIONAL_SCHEDULE_H
+#define ROTATIONAL_SCHEDULE_H
+
+#include <vector>
+
+#include "opencl.h"
+#include "lru-cache.h"
+#include "rotational-lut.h"
+
+// How the rotational blur hands pixels to work-items
+enum RotationalScheduling
+{
+    // One work-item per pixel over a 2D row-major NDRange. The arc length,
+    // and so the loop count, differs wildly between the lanes of a group.
+    SCHEDULE_ROWS,
+    // Pixels grouped into rings of equal sample count, heaviest rings
+    // first, handed out in chunks of one work-group through an atomic
+    // counter to a persistent set of groups
+    SCHEDULE_BANDS,
+};
+
+// Work-items per group of the banded kernels, also the chunk size
+constexpr unsigned BandGroupSize(64);
+
+// Pixels (x | y << 16) ordered by descending sample count, and by angle
+// around the centre within one count so that neighbouring lanes read
+// neighbouring arcs
+std::vector<cl_uint> build_band_schedule(RotationalGeometry const& geometry);
+
+// Tiles (tx | ty << 16) of a tilesX x tilesY grid along a Hilbert curve
+// over the enclosing power of two square, tiles outside the grid skipped
+std::vector<cl_uint> build_hilbert_tile_order(int tilesX, int tilesY);
+
+struct RotationalScheduleCache
+{
+    struct Entry
+    {
+        cl::Buffer pixels;
+        cl_uint count;
+    };
+
+    static constexpr size_t DefaultBudget = 64 << 20;
+
+    RotationalScheduleCache(cl::Context const& context, size_t budget = DefaultBudget) :
+        context_ (context),
+        cache_ (budget)
+    {
+    }
+
+    // nullptr if the schedule does not fit into the budget
+    Entry const* get(cl::CommandQueue& queue, RotationalGeometry const& geometry);
+
+    void setBudget(size_t budget)
+    {
+        cache_.setBudget(budget);
+    }
+
+private:
+    cl::Context context_;
+    LruCache<RotationalGeometry, Entry> cache_;
+};
+
+#endif // ROTATIONAL_SCHEDULE_H
@@ -0,0 +1,811 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+
+#include "opencl.h"
+#include "convolution.h"
+#include "rotational-kernels.h"
+#include "rotational-sweep.h"
+
+static constexpr unsigned PixelSize = 16;
+static constexpr unsigned BlockBins = 64;
+static constexpr double Pi = 3.14159265358979323846;
+
+static const std::string sweep_kernel_source = rotational_sampling_source + KERNEL_SOURCE(
+    // Inclusive scan of one value per lane over a group of 64
+    float4 block_scan(__local float4* scan, uint lane, float4 value)
+    {
+        scan[lane] = value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (uint offset = 1; offset < 64; offset <<= 1)
+        {
+            float4 before = lane >= offset ? scan[lane - offset] : (float4)(0.0f);
+            barrier(CLK_LOCAL_MEM_FENCE);
+            scan[lane] += before;
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+
+        return scan[lane];
+    }
+
+    // One group per block of 64 bins of a ring: every lane samples its
+    // bin, the group writes their running sum and the block sum
+    __kernel void sweep_rings(__global const float4* imageIn,
+                              __global float4* prefix,
+                              __global float4* offsets,
+                              __global const uint* blockFirst,
+                              __global const uint* blockRing,
+                              int width,
+                              int height)
+    {
+        __local float4 scan[64];
+
+        uint block = get_group_id(0);
+        uint lane = get_local_id(0);
+        uint ring = blockRing[block];
+        uint first = blockFirst[ring];
+        float bins = 64.0f * (blockFirst[ring + 1] - first);
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float phi = (64 * (block - first) + lane + 0.5f) * (2.0f * M_PI_F / bins);
+        float4 value = sample_bilinear(imageIn, width, height, cx + ring * cos(phi), cy + ring * sin(phi));
+
+        float4 sum = block_scan(scan, lane, value);
+        prefix[get_global_id(0)] = sum;
+        if (lane == 63)
+            offsets[block] = sum;
+    }
+
+    // Same for blocks of 64 samples of a spoke, sample j at radius j
+    __kernel void sweep_spokes(__global const float4* imageIn,
+                               __global float4* prefix,
+                               __global float4* offsets,
+                               int width,
+                               int height,
+                               int spokes,
+                               int blocksPerSpoke)
+    {
+        __local float4 scan[64];
+
+        uint block = get_group_id(0);
+        uint lane = get_local_id(0);
+        int spoke = block / blocksPerSpoke;
+        float radius = 64 * (block % blocksPerSpoke) + lane;
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float phi = (spoke + 0.5f) * (2.0f * M_PI_F / spokes);
+        float4 value = sample_bilinear(imageIn, width, height, cx + radius * cos(phi), cy + radius * sin(phi));
+
+        float4 sum = block_scan(scan, lane, value);
+        prefix[get_global_id(0)] = sum;
+        if (lane == 63)
+            offsets[block] = sum;
+    }
+
+    // Turns the block sums of each ring or spoke into the sum of the
+    // blocks before
+    __kernel void sweep_offsets(__global float4* offsets,
+                                __global float4* totals,
+                                __global const uint* blockFirst,
+                                int lines)
+    {
+        int line = get_global_id(0);
+        if (line >= lines)
+            return;
+
+        float4 sum = (float4)(0.0f);
+        for (uint block = blockFirst[line]; block < blockFirst[line + 1]; block++)
+        {
+            float4 total = offsets[block];
+            offsets[block] = sum;
+            sum += total;
+        }
+
+        totals[line] = sum;
+    }
+
+    // Splits a position in bins into whole turns, bin and fraction
+    void locate(float u, int bins, float* turns, int* bin, float* fraction)
+    {
+        *turns = floor(u / bins);
+        float rest = u - *turns * bins;
+        *bin = clamp((int)floor(rest), 0, bins - 1);
+        *fraction = rest - *bin;
+    }
+
+    // Mean of `ring` over the arc of `angle` centred on `theta`. Bin k
+    // covers positions k..k+1. The sum is assembled from differences of
+    // like terms so that it stays exact for short arcs.
+    float4 ring_mean(__global const float4* prefix,
+                     __global const float4* offsets,
+                     __global const float4* totals,
+                     __global const uint* blockFirst,
+                     int ring,
+                     float theta,
+                     float angle)
+    {
+        uint first = blockFirst[ring];
+        int bins = 64 * (blockFirst[ring + 1] - first);
+        float scale = bins / (2.0f * M_PI_F);
+        float u0 = (theta - 0.5f * angle) * scale;
+        float u1 = (theta + 0.5f * angle) * scale;
+
+        float turns0;
+        float turns1;
+        int k0;
+        int k1;
+        float f0;
+        float f1;
+        locate(u0, bins, &turns0, &k0, &f0);
+        locate(u1, bins, &turns1, &k1, &f1);
+
+        prefix += 64 * first;
+        offsets += first;
+
+        // Running sums before each bin (within its block) and the bins
+        float4 before0 = (k0 & 63) ? prefix[k0 - 1] : (float4)(0.0f);
+        float4 before1 = (k1 & 63) ? prefix[k1 - 1] : (float4)(0.0f);
+        float4 bin0 = prefix[k0] - before0;
+        float4 bin1 = prefix[k1] - before1;
+
+        float length = u1 - u0;
+        if (length <= 0.0f)
+            return bin0;
+
+        float4 sum = (turns1 - turns0) * totals[ring]
+                   + (offsets[k1 >> 6] - offsets[k0 >> 6])
+                   + (before1 - before0)
+                   + (f1 * bin1 - f0 * bin0);
+
+        return sum / length;
+    }
+
+    __kernel void sweep_spin(__global const float4* prefix,
+                             __global const float4* offsets,
+                             __global const float4* totals,
+                             __global const uint* blockFirst,
+                             __global float4* imageOut,
+                             int width,
+                             int height,
+                             int rings,
+                             float angle)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        int inner = min((int)radius, rings - 2);
+        float4 a = ring_mean(prefix, offsets, totals, blockFirst, inner, theta, angle);
+        float4 b = ring_mean(prefix, offsets, totals, blockFirst, inner + 1, theta, angle);
+
+        imageOut[y*width + x] = mix(a, b, radius - inner);
+    }
+
+    // Mean of `spoke` over positions u0..u1, sample j covers j..j+1
+    float4 spoke_mean(__global const float4* prefix,
+                      __global const float4* offsets,
+                      int spoke,
+                      int length,
+                      float u0,
+                      float u1)
+    {
+        prefix += spoke * length;
+        offsets += spoke * (length >> 6);
+
+        u0 = clamp(u0, 0.0f, (float)length);
+        u1 = clamp(u1, 0.0f, (float)length);
+        int k0 = min((int)u0, length - 1);
+        int k1 = min((int)u1, length - 1);
+        float f0 = u0 - k0;
+        float f1 = u1 - k1;
+
+        float4 before0 = (k0 & 63) ? prefix[k0 - 1] : (float4)(0.0f);
+        float4 before1 = (k1 & 63) ? prefix[k1 - 1] : (float4)(0.0f);
+        float4 bin0 = prefix[k0] - before0;
+        float4 bin1 = prefix[k1] - before1;
+
+        float extent = u1 - u0;
+        if (extent <= 0.0f)
+            return bin0;
+
+        float4 sum = (offsets[k1 >> 6] - offsets[k0 >> 6])
+                   + (before1 - before0)
+                   + (f1 * bin1 - f0 * bin0);
+
+        return sum / extent;
+    }
+
+    __kernel void sweep_zoom(__global const float4* prefix,
+                             __global const float4* offsets,
+                             __global float4* imageOut,
+                             int width,
+                             int height,
+                             int spokes,
+                             int length,
+                             float strength)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        // Spoke k lies at angle (k + 0.5) * 2pi / spokes
+        float v = theta * (spokes / (2.0f * M_PI_F)) - 0.5f;
+        float fv = floor(v);
+        int k0 = (int)fv;
+        if (k0 < 0)
+            k0 += spokes;
+        int k1 = k0 + 1 < spokes ? k0 + 1 : 0;
+
+        float u0 = radius * (1.0f - 0.5f * strength) + 0.5f;
+        float u1 = radius * (1.0f + 0.5f * strength) + 0.5f;
+
+        float4 a = spoke_mean(prefix, offsets, k0, length, u0, u1);
+        float4 b = spoke_mean(prefix, offsets, k1, length, u0, u1);
+
+        imageOut[y*width + x] = mix(a, b, v - fv);
+    }
+
+    // Bin k of a ring from its running sums
+    float4 ring_bin(__global const float4* prefix, int k)
+    {
+        return (k & 63) ? prefix[k] - prefix[k - 1] : prefix[k];
+    }
+
+    // One work-item per ring: Young-van Vliet recursive Gaussian of
+    // `sigma` radians along the bins of the ring, forward then backward.
+    // Each pass starts with a lead-in over the bins before the start of
+    // the ring so that the filter state wraps around. Outer rings are the
+    // longest and go to the first work-items.
+    __kernel void sweep_gaussian(__global const float4* prefix,
+                                 __global float4* filtered,
+                                 __global const uint* blockFirst,
+                                 int rings,
+                                 float sigma)
+    {
+        int ring = rings - 1 - (int)get_global_id(0);
+        if (ring < 0)
+            return;
+
+        uint first = blockFirst[ring];
+        int bins = 64 * (blockFirst[ring + 1] - first);
+        prefix += 64 * first;
+        filtered += 64 * first;
+
+        float s = sigma * (bins / (2.0f * M_PI_F));
+        if (s < 0.5f)
+        {
+            for (int k = 0; k < bins; k++)
+                filtered[k] = ring_bin(prefix, k);
+            return;
+        }
+
+        float q = s >= 2.5f ? 0.98711f * s - 0.96330f : 3.97156f - 4.14554f * sqrt(1.0f - 0.26891f * s);
+        float q2 = q * q;
+        float q3 = q2 * q;
+        float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+        float a1 = (2.44413f * q + 2.85619f * q2 + 1.26661f * q3) / b0;
+        float a2 = -(1.4281f * q2 + 1.26661f * q3) / b0;
+        float a3 = 0.422205f * q3 / b0;
+        float gain = 1.0f - (a1 + a2 + a3);
+
+        int lead = min(bins, (int)(4.0f * s) + 3);
+
+        float4 w1 = ring_bin(prefix, bins - lead);
+        float4 w2 = w1;
+        float4 w3 = w1;
+        for (int k = bins - lead; k < bins + bins; k++)
+        {
+            float4 w = gain * ring_bin(prefix, k % bins) + a1 * w1 + a2 * w2 + a3 * w3;
+            w3 = w2;
+            w2 = w1;
+            w1 = w;
+            if (k >= bins)
+                filtered[k - bins] = w;
+        }
+
+        // In place: the lead-in reads bins lead-1..0, which are written last
+        w1 = filtered[lead - 1];
+        w2 = w1;
+        w3 = w1;
+        for (int k = lead - 1 + bins; k >= 0; k--)
+        {
+            float4 w = gain * filtered[k % bins] + a1 * w1 + a2 * w2 + a3 * w3;
+            w3 = w2;
+            w2 = w1;
+            w1 = w;
+            if (k < bins)
+                filtered[k] = w;
+        }
+    }
+
+    // Filtered ring `ring` at angle theta, bin k lies at (k + 0.5) * 2pi / bins
+    float4 ring_sample(__global const float4* filtered,
+                       __global const uint* blockFirst,
+                       int ring,
+                       float theta)
+    {
+        uint first = blockFirst[ring];
+        int bins = 64 * (blockFirst[ring + 1] - first);
+        filtered += 64 * first;
+
+        float v = theta * (bins / (2.0f * M_PI_F)) - 0.5f;
+        float fv = floor(v);
+        int k0 = (int)fv;
+        if (k0 < 0)
+            k0 += bins;
+        int k1 = k0 + 1 < bins ? k0 + 1 : 0;
+
+        return mix(filtered[k0], filtered[k1], v - fv);
+    }
+
+    __kernel void sweep_resample(__global const float4* filtered,
+                                 __global const uint* blockFirst,
+                                 __global float4* imageOut,
+                                 int width,
+                                 int height,
+                                 int rings)
+    {
+        int x = get_global_id(0);
+        int y = get_global_id(1);
+
+        if (x >= width || y >= height)
+            return;
+
+        float cx = 0.5f * (width - 1);
+        float cy = 0.5f * (height - 1);
+        float dx = x - cx;
+        float dy = y - cy;
+
+        float radius = sqrt(dx*dx + dy*dy);
+        float theta = atan2(dy, dx);
+
+        int inner = min((int)radius, rings - 2);
+        float4 a = ring_sample(filtered, blockFirst, inner, theta);
+        float4 b = ring_sample(filtered, blockFirst, inner + 1, theta);
+
+        imageOut[y*width + x] = mix(a, b, radius - inner);
+    }
+);
+
+int rotational_sweep_blocks(int ring)
+{
+    return std::max(1, int(std::ceil(2.0 * Pi * ring / BlockBins)));
+}
+
+int rotational_sweep_rings(int width, int height)
+{
+    // Pixels up to the corners lie between two rings
+    double cx = 0.5 * (width - 1);
+    double cy = 0.5 * (height - 1);
+    return int(std::sqrt(cx*cx + cy*cy)) + 2;
+}
+
+RotationalSweepCost rotational_sweep_gaussian_cost(int width, int height, float sigma)
+{
+    // Counted as sweep_gaussian works: ring_bin() subtracts for all but the
+    // first bin of each block, a filter step is 4 float4 multiplies and 3
+    // adds. Rings of less than half a bin of spread are copied.
+    constexpr double StepFlops = 7.0 * 4.0;
+    constexpr double BinFlops = 4.0 * (BlockBins - 1) / BlockBins;
+
+    RotationalSweepCost cost;
+    int rings = rotational_sweep_rings(width, height);
+    for (int ring = 0; ring < rings; ring++)
+    {
+        double bins = double(BlockBins) * rotational_sweep_blocks(ring);
+        float s = sigma * float(bins / (2.0 * Pi));
+        cost.bins += bins;
+
+        if (s < 0.5f)
+        {
+            cost.bytes += 2.0 * bins * PixelSize;
+            cost.flops += BinFlops * bins;
+            continue;
+        }
+
+        // Forward then backward, each stepping through the lead-in and the
+        // ring, reading a bin per step and writing the ring
+        double steps = bins + std::min(bins, double(int(4.0f * s) + 3));
+        cost.bytes += 2.0 * (steps + bins) * PixelSize;
+        cost.flops += 2.0 * StepFlops * steps + BinFlops * steps;
+    }
+
+    return cost;
+}
+
+size_t RotationalPolar::bytes() const
+{
+    size_t bytes = 0;
+    if (rings)
+        bytes += ringPrefix.getInfo<CL_MEM_SIZE>() + ringOffsets.getInfo<CL_MEM_SIZE>() + ringTotals.getInfo<CL_MEM_SIZE>();
+    if (spokes)
+        bytes += spokePrefix.getInfo<CL_MEM_SIZE>() + spokeOffsets.getInfo<CL_MEM_SIZE>() + spokeTotals.getInfo<CL_MEM_SIZE>();
+    return bytes;
+}
+
+RotationalSweep::RotationalSweep(cl::Context const& context) :
+    context_ (context),
+    device_ (),
+    queue_ (),
+    program_ (),
+    ringsKernel_ (),
+    spokesKernel_ (),
+    offsetsKernel_ (),
+    spinKernel_ (),
+    zoomKernel_ (),
+    gaussianKernel_ (),
+    resampleKernel_ (),
+    width_ (0),
+    height_ (0),
+    rings_ (0),
+    blocks_ (0),
+    blockFirst_ (),
+    blockRing_ (),
+    filtered_ (),
+    spokes_ (0),
+    spokeLength_ (0),
+    spokeFirst_ ()
+{
+    auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+    if (devices.empty())
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "RotationalSweep");
+
+    device_ = devices.front();
+    queue_ = cl::CommandQueue(context_, device_);
+
+    program_ = cl::Program(context_, sweep_kernel_source);
+    try
+    {
+        program_.build({device_});
+    }
+    catch (cl::Error const&)
+    {
+        std::cerr << "BUILD INFO: " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+        throw;
+    }
+
+    ringsKernel_ = cl::Kernel(program_, "sweep_rings");
+    spokesKernel_ = cl::Kernel(program_, "sweep_spokes");
+    offsetsKernel_ = cl::Kernel(program_, "sweep_offsets");
+    spinKernel_ = cl::Kernel(program_, "sweep_spin");
+    zoomKernel_ = cl::Kernel(program_, "sweep_zoom");
+    gaussianKernel_ = cl::Kernel(program_, "sweep_gaussian");
+    resampleKernel_ = cl::Kernel(program_, "sweep_resample");
+}
+
+void RotationalSweep::prepare(cl::CommandQueue& queue, int width, int height)
+{
+    if (width == width_ && height == height_)
+        return;
+
+    int rings = rotational_sweep_rings(width, height);
+
+    std::vector<cl_uint> blockFirst(1, 0);
+    std::vector<cl_uint> blockRing;
+    for (int ring = 0; ring < rings; ring++)
+    {
+        blockRing.insert(blockRing.end(), rotational_sweep_blocks(ring), cl_uint(ring));
+        blockFirst.push_back(cl_uint(blockRing.size()));
+    }
+
+    // As many spokes as the outer ring has bins
+    int spokes = BlockBins * rotational_sweep_blocks(rings - 1);
+    int blocksPerSpoke = int(std::ceil(1.5 * rings / BlockBins));
+    std::vector<cl_uint> spokeFirst;
+    for (int spoke = 0; spoke <= spokes; spoke++)
+        spokeFirst.push_back(cl_uint(spoke * blocksPerSpoke));
+
+    blocks_ = cl_uint(blockRing.size());
+    blockFirst_ = cl::Buffer(context_, CL_MEM_READ_ONLY, blockFirst.size() * sizeof(cl_uint));
+    blockRing_ = cl::Buffer(context_, CL_MEM_READ_ONLY, blockRing.size() * sizeof(cl_uint));
+    spokeFirst_ = cl::Buffer(context_, CL_MEM_READ_ONLY, spokeFirst.size() * sizeof(cl_uint));
+    filtered_ = cl::Buffer(context_, CL_MEM_READ_WRITE, blockRing.size() * BlockBins * PixelSize);
+
+    queue.enqueueWriteBuffer(blockFirst_, CL_TRUE, 0, blockFirst.size() * sizeof(cl_uint), blockFirst.data());
+    queue.enqueueWriteBuffer(blockRing_, CL_TRUE, 0, blockRing.size() * sizeof(cl_uint), blockRing.data());
+    queue.enqueueWriteBuffer(spokeFirst_, CL_TRUE, 0, spokeFirst.size() * sizeof(cl_uint), spokeFirst.data());
+
+    width_ = width;
+    height_ = height;
+    rings_ = rings;
+    spokes_ = spokes;
+    spokeLength_ = blocksPerSpoke * BlockBins;
+}
+
+void RotationalSweep::launch(cl::CommandQueue& queue,
+                             cl::Kernel& kernel,
+                             cl::NDRange const& globalSize,
+                             cl::NDRange const& localSize,
+                             std::vector<cl::Event>* events)
+{
+    cl::Event event;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalSize, localSize, nullptr, events ? &event : nullptr);
+    if (events)
+        events->push_back(event);
+}
+
+void RotationalSweep::buildRings(cl::CommandQueue& queue, RotationalPolar& polar, std::vector<cl::Event>* events)
+{
+    if (polar.rings)
+        return;
+
+    int width = polar.width;
+    int height = polar.height;
+
+    polar.ringPrefix = cl::Buffer(context_, CL_MEM_READ_WRITE, size_t(blocks_) * BlockBins * PixelSize);
+    polar.ringOffsets = cl::Buffer(context_, CL_MEM_READ_WRITE, size_t(blocks_) * PixelSize);
+    polar.ringTotals = cl::Buffer(context_, CL_MEM_READ_WRITE, size_t(rings_) * PixelSize);
+
+    ringsKernel_.setArg(0, polar.image);
+    ringsKernel_.setArg(1, polar.ringPrefix);
+    ringsKernel_.setArg(2, polar.ringOffsets);
+    ringsKernel_.setArg(3, blockFirst_);
+    ringsKernel_.setArg(4, blockRing_);
+    ringsKernel_.setArg(5, width);
+    ringsKernel_.setArg(6, height);
+    launch(queue, ringsKernel_, cl::NDRange(size_t(blocks_) * BlockBins), cl::NDRange(BlockBins), events);
+
+    offsetsKernel_.setArg(0, polar.ringOffsets);
+    offsetsKernel_.setArg(1, polar.ringTotals);
+    offsetsKernel_.setArg(2, blockFirst_);
+    offsetsKernel_.setArg(3, rings_);
+    launch(queue, offsetsKernel_, cl::NDRange(roundUp(rings_, BlockBins)), cl::NDRange(BlockBins), events);
+
+    polar.rings = true;
+}
+
+void RotationalSweep::buildSpokes(cl::CommandQueue& queue, RotationalPolar& polar, std::vector<cl::Event>* events)
+{
+    if (polar.spokes)
+        return;
+
+    int width = polar.width;
+    int height = polar.height;
+    int blocksPerSpoke = spokeLength_ / BlockBins;
+    size_t blocks = size_t(spokes_) * blocksPerSpoke;
+
+    polar.spokePrefix = cl::Buffer(context_, CL_MEM_READ_WRITE, blocks * BlockBins * PixelSize);
+    polar.spokeOffsets = cl::Buffer(context_, CL_MEM_READ_WRITE, blocks * PixelSize);
+    polar.spokeTotals = cl::Buffer(context_, CL_MEM_READ_WRITE, size_t(spokes_) * PixelSize);
+
+    spokesKernel_.setArg(0, polar.image);
+    spokesKernel_.setArg(1, polar.spokePrefix);
+    spokesKernel_.setArg(2, polar.spokeOffsets);
+    spokesKernel_.setArg(3, width);
+    spokesKernel_.setArg(4, height);
+    spokesKernel_.setArg(5, spokes_);
+    spokesKernel_.setArg(6, blocksPerSpoke);
+    launch(queue, spokesKernel_, cl::NDRange(blocks * BlockBins), cl::NDRange(BlockBins), events);
+
+    offsetsKernel_.setArg(0, polar.spokeOffsets);
+    offsetsKernel_.setArg(1, polar.spokeTotals);
+    offsetsKernel_.setArg(2, spokeFirst_);
+    offsetsKernel_.setArg(3, spokes_);
+    launch(queue, offsetsKernel_, cl::NDRange(roundUp(spokes_, BlockBins)), cl::NDRange(BlockBins), events);
+
+    polar.spokes = true;
+}
+
+void RotationalSweep::enqueueSpin(cl::CommandQueue& queue,
+                                  RotationalPolar& polar,
+                                  std::vector<cl::Buffer>& devOutputImages,
+                                  std::vector<float> const& angles,
+                                  std::vector<cl::Event>* events)
+{
+    int width = polar.width;
+    int height = polar.height;
+    prepare(queue, width, height);
+    buildRings(queue, polar, events);
+
+    spinKernel_.setArg(0, polar.ringPrefix);
+    spinKernel_.setArg(1, polar.ringOffsets);
+    spinKernel_.setArg(2, polar.ringTotals);
+    spinKernel_.setArg(3, blockFirst_);
+    spinKernel_.setArg(5, width);
+    spinKernel_.setArg(6, height);
+    spinKernel_.setArg(7, rings_);
+
+    for (size_t i = 0; i < angles.size(); i++)
+    {
+        spinKernel_.setArg(4, devOutputImages[i]);
+        spinKernel_.setArg(8, angles[i]);
+        launch(queue, spinKernel_, cl::NDRange(roundUp(width, WGX), roundUp(height, WGY)), cl::NDRange(WGX, WGY), events);
+    }
+}
+
+void RotationalSweep::enqueueZoom(cl::CommandQueue& queue,
+                                  RotationalPolar& polar,
+                                  std::vector<cl::Buffer>& devOutputImages,
+                                  std::vector<float> const& strengths,
+                                  std::vector<cl::Event>* events)
+{
+    int width = polar.width;
+    int height = polar.height;
+    prepare(queue, width, height);
+    buildSpokes(queue, polar, events);
+
+    zoomKernel_.setArg(0, polar.spokePrefix);
+    zoomKernel_.setArg(1, polar.spokeOffsets);
+    zoomKernel_.setArg(3, width);
+    zoomKernel_.setArg(4, height);
+    zoomKernel_.setArg(5, spokes_);
+    zoomKernel_.setArg(6, spokeLength_);
+
+    for (size_t i = 0; i < strengths.size(); i++)
+    {
+        zoomKernel_.setArg(2, devOutputImages[i]);
+        zoomKernel_.setArg(7, strengths[i]);
+        launch(queue, zoomKernel_, cl::NDRange(roundUp(width, WGX), roundUp(height, WGY)), cl::NDRange(WGX, WGY), events);
+    }
+}
+
+void RotationalSweep::enqueueGaussian(cl::CommandQueue& queue,
+                                      RotationalPolar& polar,
+                                      std::vector<cl::Buffer>& devOutputImages,
+                                      std::vector<float> const& sigmas,
+                                      std::vector<cl::Event>* events)
+{
+    int width = polar.width;
+    int height = polar.height;
+    prepare(queue, width, height);
+    buildRings(queue, polar, events);
+
+    gaussianKernel_.setArg(0, polar.ringPrefix);
+    gaussianKernel_.setArg(1, filtered_);
+    gaussianKernel_.setArg(2, blockFirst_);
+    gaussianKernel_.setArg(3, rings_);
+
+    resampleKernel_.setArg(0, filtered_);
+    resampleKernel_.setArg(1, blockFirst_);
+    resampleKernel_.setArg(3, width);
+    resampleKernel_.setArg(4, height);
+    resampleKernel_.setArg(5, rings_);
+
+    for (size_t i = 0; i < sigmas.size(); i++)
+    {
+        gaussianKernel_.setArg(4, sigmas[i]);
+        launch(queue, gaussianKernel_, cl::NDRange(roundUp(rings_, BlockBins)), cl::NDRange(BlockBins), events);
+
+        resampleKernel_.setArg(2, devOutputImages[i]);
+        launch(queue, resampleKernel_, cl::NDRange(roundUp(width, WGX), roundUp(height, WGY)), cl::NDRange(WGX, WGY), events);
+    }
+}
+
+void RotationalSweep::enqueue(cl::CommandQueue& queue,
+                              cl::Buffer const& devInputImage,
+                              std::vector<cl::Buffer>& devOutputImages,
+                              int width,
+                              int height,
+                              std::vector<float> const& angles,
+                              std::vector<cl::Event>* events)
+{
+    RotationalPolar polar(devInputImage, width, height);
+    enqueueSpin(queue, polar, devOutputImages, angles, events);
+}
+
+static RotationalSweep& sweep_engine(cl::Context const& context)
+{
+    static std::map<cl_context, std::unique_ptr<RotationalSweep>> engines;
+
+    auto& engine = engines[context()];
+    if (!engine)
+        engine.reset(new RotationalSweep(context));
+
+    return *engine;
+}
+
+int rotational_blur_sweep(cl::Context& context,
+                          float const* image,
+                          int width,
+                          int height,
+                          std::vector<float> const& angles,
+                          std::vector<float*> const& outputs)
+{
+    int ret = CL_SUCCESS;
+
+    try
+    {
+        size_t length = size_t(width) * height;
+
+        auto& sweep = sweep_engine(context);
+        auto queue = sweep.queue();
+
+        cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * PixelSize,
+                                 const_cast<float*>(image));
+        std::vector<cl::Buffer> devOutputImages;
+        for (size_t i = 0; i < angles.size(); i++)
+            devOutputImages.push_back(cl::Buffer(context, CL_MEM_WRITE_ONLY, length * PixelSize));
+
+        sweep.enqueue(queue, devInputImage, devOutputImages, width, height, angles);
+
+        for (size_t i = 0; i < angles.size(); i++)
+            queue.enqueueReadBuffer(devOutputImages[i], CL_FALSE, 0, length * PixelSize, outputs[i]);
+        queue.finish();
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        ret = err.err();
+    }
+
+    return ret;
+}
+
+int rotational_blur_gaussian(cl::Context& context, float* image, int width, int height, float sigma)
+{
+    int ret = CL_SUCCESS;
+
+    try
+    {
+        size_t length = size_t(width) * height;
+
+        auto& sweep = sweep_engine(context);
+        auto queue = sweep.queue();
+
+        cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * PixelSize, image);
+        std::vector<cl::Buffer> devOutputImages {cl::Buffer(context, CL_MEM_WRITE_ONLY, length * PixelSize)};
+
+        RotationalPolar polar(devInputImage, width, height);
+        sweep.enqueueGaussian(queue, polar, devOutputImages, {sigma});
+        queue.enqueueReadBuffer(devOutputImages.front(), CL_TRUE, 0, length * PixelSize, image);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        ret = err.err();
+    }
+
+    return ret;
+}
+
+int zoom_blur(cl::Context& context, float* image, int width, int height, float strength)
+{
+    int ret = CL_SUCCESS;
+
+    try
+    {
+        size_t length = size_t(width) * height;
+
+        auto& sweep = sweep_engine(context);
+        auto queue = sweep.queue();
+
+        cl::Buffer devInputImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, length * PixelSize, image);
+        std::vector<cl::Buffer> devOutputImages {cl::Buffer(context, CL_MEM_WRITE_ONLY, length * PixelSize)};
+
+        RotationalPolar polar(devInputImage, width, height);
+        sweep.enqueueZoom(queue, polar, devOutputImages, {strength});
+        queue.enqueueReadBuffer(devOutputImages.front(), CL_TRUE, 0, length * PixelSize, image);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: OpenCL => " << err.what() << std::endl;
+        ret = err.err();
+    }
+
+    return ret;
+}
@@ -0,0 +1,198 @@
+#ifndef ROTATIONAL_SWEEP_H
+#define ROTATIONAL_SWEEP_H
+
+#include <vector>
+
+#include "opencl.h"
+
+// Polar running sums of one image, shared by the spin and zoom blurs of
+// RotationalSweep. The tables of either blur are built by its first
+// enqueue call and reused by every later one on the same object, so an
+// image is resampled at most once per blur whatever the number of
+// angles and strengths. Rings and spokes are separate grids, each sized
+// for its own direction, so running both blurs resamples twice. Call
+// reset() after changing the image.
+struct RotationalPolar
+{
+    RotationalPolar(cl::Buffer const& devInputImage, int width, int height) :
+        image (devInputImage),
+        width (width),
+        height (height)
+    {
+    }
+
+    void reset()
+    {
+        rings = false;
+        spokes = false;
+    }
+
+    // Device memory of the tables built so far
+    size_t bytes() const;
+
+    cl::Buffer image;
+    int width;
+    int height;
+
+    // Running sums along the rings, see RotationalSweep::enqueueSpin()
+    bool rings = false;
+    cl::Buffer ringPrefix;
+    cl::Buffer ringOffsets;
+    cl::Buffer ringTotals;
+
+    // Running sums along the spokes, see RotationalSweep::enqueueZoom()
+    bool spokes = false;
+    cl::Buffer spokePrefix;
+    cl::Buffer spokeOffsets;
+    cl::Buffer spokeTotals;
+};
+
+// Rotational (spin) and radial (zoom) blurs around the image centre at
+// constant cost per output pixel, whatever the angle or strength.
+//
+// Spin: the input is resampled onto polar rings one pixel apart. Ring r
+// has a multiple of 64 angular bins, at least 2*pi*r so that no bin is
+// longer than a pixel, and keeps the running sum of its bins within each
+// block of 64 bins plus the sum of the blocks before. The mean along any
+// arc of a ring is then a difference of two interpolated prefix sums
+// divided by the arc length in bins, so every angle costs one cheap pass
+// over the output. Pixels between two rings blend both ring means.
+//
+// Gaussian spin: every ring is filtered along its bins by the recursive
+// Young-van Vliet approximation of a Gaussian of `sigma` radians,
+// forward and backward, then resampled like the spin blur. The filter
+// wraps around the ring by a lead-in of 4 sigma, spreads whose lead-in
+// exceeds a turn do not wrap more than once.
+//
+// Zoom: same as spin along spokes, one per outer ring bin, sampled one pixel
+// apart out to 1.5 times the corner radius. A pixel at radius r is the
+// mean over radii r * (1 - strength/2) .. r * (1 + strength/2), blended
+// between the two spokes around it. Strengths above 1 are cut off at the
+// end of the spokes.
+//
+// Results approximate sampling the arcs directly, the polar resampling
+// adds a bilinear filter of about a pixel.
+struct RotationalSweep
+{
+    RotationalSweep(cl::Context const& context);
+
+    // Spin blurs polar.image by angles[i] into devOutputImages[i]. The
+    // events of all launches are appended to `events` if given.
+    void enqueueSpin(cl::CommandQueue& queue,
+                     RotationalPolar& polar,
+                     std::vector<cl::Buffer>& devOutputImages,
+                     std::vector<float> const& angles,
+                     std::vector<cl::Event>* events = nullptr);
+
+    // Gaussian spin blurs polar.image with a standard deviation of
+    // sigmas[i] radians into devOutputImages[i]. Launches are two per
+    // sigma, the filtered rings are kept in one scratch buffer.
+    void enqueueGaussian(cl::CommandQueue& queue,
+                         RotationalPolar& polar,
+                         std::vector<cl::Buffer>& devOutputImages,
+                         std::vector<float> const& sigmas,
+                         std::vector<cl::Event>* events = nullptr);
+
+    // Zoom blurs polar.image by strengths[i] into devOutputImages[i]
+    void enqueueZoom(cl::CommandQueue& queue,
+                     RotationalPolar& polar,
+                     std::vector<cl::Buffer>& devOutputImages,
+                     std::vector<float> const& strengths,
+                     std::vector<cl::Event>* events = nullptr);
+
+    // enqueueSpin() on tables that are used once
+    void enqueue(cl::CommandQueue& queue,
+                 cl::Buffer const& devInputImage,
+                 std::vector<cl::Buffer>& devOutputImages,
+                 int width,
+                 int height,
+                 std::vector<float> const& angles,
+                 std::vector<cl::Event>* events = nullptr);
+
+    cl::Context context() const
+    {
+        return context_;
+    }
+
+    cl::Device device() const
+    {
+        return device_;
+    }
+
+    cl::CommandQueue queue() const
+    {
+        return queue_;
+    }
+
+private:
+    // Ring and spoke layout for width x height images
+    void prepare(cl::CommandQueue& queue, int width, int height);
+
+    // Tables of `polar` unless built already
+    void buildRings(cl::CommandQueue& queue, RotationalPolar& polar, std::vector<cl::Event>* events);
+    void buildSpokes(cl::CommandQueue& queue, RotationalPolar& polar, std::vector<cl::Event>* events);
+
+    void launch(cl::CommandQueue& queue,
+                cl::Kernel& kernel,
+                cl::NDRange const& globalSize,
+                cl::NDRange const& localSize,
+                std::vector<cl::Event>* events);
+
+    cl::Context context_;
+    cl::Device device_;
+    cl::CommandQueue queue_;
+    cl::Program program_;
+    cl::Kernel ringsKernel_;
+    cl::Kernel spokesKernel_;
+    cl::Kernel offsetsKernel_;
+    cl::Kernel spinKernel_;
+    cl::Kernel zoomKernel_;
+    cl::Kernel gaussianKernel_;
+    cl::Kernel resampleKernel_;
+    int width_;
+    int height_;
+    int rings_;
+    cl_uint blocks_;
+    cl::Buffer blockFirst_;         // first block of each ring, plus end
+    cl::Buffer blockRing_;          // ring of each block
+    cl::Buffer filtered_;           // ring bins of the Gaussian spin blur
+    int spokes_;
+    int spokeLength_;               // samples per spoke, a multiple of 64
+    cl::Buffer spokeFirst_;         // first block of each spoke, plus end
+};
+
+// Blocks of 64 bins on ring `ring`, see RotationalSweep
+int rotational_sweep_blocks(int ring);
+
+// Rings of the polar tables of width x height images
+int rotational_sweep_rings(int width, int height);
+
+// Work of one Gaussian filter launch of enqueueGaussian() over all rings
+struct RotationalSweepCost
+{
+    double bins = 0;    // ring bins filtered
+    double bytes = 0;   // bin reads and writes, lead-ins included
+    double flops = 0;
+};
+
+RotationalSweepCost rotational_sweep_gaussian_cost(int width, int height, float sigma);
+
+// Blurs `image` by each of `angles` into the matching `outputs` (width x
+// height float4 pixels each). Returns CL_SUCCESS or the OpenCL error code.
+int rotational_blur_sweep(cl::Context& context,
+                          float const* image,
+                          int width,
+                          int height,
+                          std::vector<float> const& angles,
+                          std::vector<float*> const& outputs);
+
+// Gaussian spin blurs `image` in place with a standard deviation of
+// `sigma` radians, see RotationalSweep. Returns CL_SUCCESS or the OpenCL
+// error code.
+int rotational_blur_gaussian(cl::Context& context, float* image, int width, int height, float sigma);
+
+// Zoom blurs `image` in place, see RotationalSweep. Returns CL_SUCCESS or
+// the OpenCL error code.
+int zoom_blur(cl::Context& context, float* image, int width, int height, float strength);
+
+#endif // ROTATIONAL_SWEEP_H
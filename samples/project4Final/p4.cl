@@ -258,6 +258,10 @@ __kernel void convolveConstantLocal( read_only image2d_t inputImage, write_only
 // CONVOLUTION WITH GLOBAL MEMORY and LOCAL MEM
 __kernel void convolveGloballMemLocal( __global float4* inputImageDataBuf, read_only image2d_t inputImage, write_only image2d_t outputImage, sampler_t inputImageSampler, sampler_t outputImageSampler, int imageWidth, int imageHeight, __global float* filter, int filterWidth, unsigned int width, unsigned int height, unsigned int counter )
 {
+    //Goes up to 7x7 filters 
+    //__local variables have to be declared at kernel scope
+    __local float4 P[BLOCK_DIM+6][BLOCK_DIM+6];//Identification of this workgroup
+    
     //init- copy from input texture to global float mem 
     if( counter < 2  )
     {       
@@ -277,9 +281,6 @@ __kernel void convolveGloballMemLocal( __global float4* inputImageDataBuf, read_
         int w = filterWidth;
         int wBy2 = w>>1; //w divided by 2
         
-        //Goes up to 7x7 filters 
-        __local float4 P[BLOCK_DIM+6][BLOCK_DIM+6];//Identification of this workgroup
-        
         int i = get_group_id(0);
         int j = get_group_id(1); //Identification of work-item
         int idX = get_local_id(0);
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <sstream>
+
+#include "convolution.h"
+#include "stencil-chain.h"
+
+static constexpr unsigned PixelSize = 16;
+// Output tile of a work-group of the fused kernel, one pixel per item
+static constexpr int TileSize = 16;
+
+StencilStage stencil_convolution(int width, std::vector<float> const& weights)
+{
+    if (width < 1 || !(width & 1) || weights.size() != size_t(width) * width)
+        throw cl::Error(CL_INVALID_VALUE, "stencil_convolution");
+
+    return StencilStage {StencilStage::CONVOLUTION, width, weights};
+}
+
+StencilStage stencil_color_matrix(std::vector<float> const& matrix)
+{
+    if (matrix.size() != 20)
+        throw cl::Error(CL_INVALID_VALUE, "stencil_color_matrix");
+
+    return StencilStage {StencilStage::COLOR_MATRIX, 1, matrix};
+}
+
+static void emit_color_matrix(std::ostringstream& source, StencilStage const& stage, char const* indent)
+{
+    static char const* channels[4] = {"value.x", "value.y", "value.z", "value.w"};
+
+    source << indent << "value = (float4)(";
+    for (int row = 0; row < 4; row++)
+    {
+        float const* m = stage.weights.data() + 5*row;
+        if (row)
+            source << ",\n" << indent << "                 ";
+        for (int c = 0; c < 4; c++)
+            source << kernel_literal(m[c]) << " * " << channels[c] << " + ";
+        source << kernel_literal(m[4]);
+    }
+    source << ");\n";
+}
+
+static int stencil_halo(std::vector<StencilStage> const& stages)
+{
+    int halo = 0;
+    for (auto const& stage : stages)
+        halo += stage.radius();
+    return halo;
+}
+
+size_t stencil_chain_local_bytes(std::vector<StencilStage> const& stages)
+{
+    // Tile A holds the input, B the output of the first convolution, later
+    // convolutions alternate into smaller tiles and the last one writes to
+    // global memory
+    int halo = stencil_halo(stages);
+    int convolutions = 0;
+    size_t bytes = 0;
+
+    for (auto const& stage : stages)
+    {
+        if (stage.kind != StencilStage::CONVOLUTION)
+            continue;
+
+        size_t side = TileSize + 2 * halo;
+        if (convolutions < 2)
+            bytes += side * side * PixelSize;
+        halo -= stage.radius();
+        convolutions++;
+    }
+
+    return bytes;
+}
+
+std::string stencil_chain_source(std::vector<StencilStage> const& stages)
+{
+    std::ostringstream source;
+
+    for (size_t k = 0; k < stages.size(); k++)
+    {
+        auto const& stage = stages[k];
+        if (stage.kind != StencilStage::CONVOLUTION)
+            continue;
+
+        source << "__constant float stage" << k << "[" << stage.weights.size() << "] = {";
+        for (size_t i = 0; i < stage.weights.size(); i++)
+            source << (i ? ", " : "") << kernel_literal(stage.weights[i]);
+        source << "};\n";
+    }
+
+    source << "\n__kernel __attribute__((reqd_work_group_size(" << TileSize << ", " << TileSize << ", 1)))\n"
+              "void stencil_chain(__global const float4* imageIn,\n"
+              "                   __global float4* imageOut,\n"
+              "                   int width,\n"
+              "                   int height)\n"
+              "{\n";
+
+    size_t first = std::find_if(stages.begin(), stages.end(), [](StencilStage const& stage)
+    {
+        return stage.kind == StencilStage::CONVOLUTION;
+    }) - stages.begin();
+
+    // Colour matrices only: one pixel per item
+    if (first == stages.size())
+    {
+        source << "    int x = get_global_id(0);\n"
+                  "    int y = get_global_id(1);\n"
+                  "    if (x >= width || y >= height)\n"
+                  "        return;\n"
+                  "\n"
+                  "    float4 value = imageIn[y*width + x];\n";
+        for (auto const& stage : stages)
+            emit_color_matrix(source, stage, "    ");
+        source << "    imageOut[y*width + x] = value;\n"
+                  "}\n";
+        return source.str();
+    }
+
+    int halo = stencil_halo(stages);
+    int side = TileSize + 2 * halo;
+    int second = side - 2 * stages[first].radius();
+    bool chained = std::any_of(stages.begin() + first + 1, stages.end(), [](StencilStage const& stage)
+    {
+        return stage.kind == StencilStage::CONVOLUTION;
+    });
+
+    source << "    __local float4 tileA[" << side * side << "];\n";
+    if (chained)
+        source << "    __local float4 tileB[" << second * second << "];\n";
+
+    source << "\n"
+              "    int ox = get_group_id(0) * " << TileSize << ";\n"
+              "    int oy = get_group_id(1) * " << TileSize << ";\n"
+              "    int lid = get_local_id(1) * " << TileSize << " + get_local_id(0);\n"
+              "\n"
+              "    for (int i = lid; i < " << side * side << "; i += " << TileSize * TileSize << ")\n"
+              "    {\n"
+              "        int gx = clamp(ox - " << halo << " + i % " << side << ", 0, width - 1);\n"
+              "        int gy = clamp(oy - " << halo << " + i / " << side << ", 0, height - 1);\n"
+              "        float4 value = imageIn[gy*width + gx];\n";
+    for (size_t k = 0; k < first; k++)
+        emit_color_matrix(source, stages[k], "        ");
+    source << "        tileA[i] = value;\n"
+              "    }\n"
+              "    barrier(CLK_LOCAL_MEM_FENCE);\n";
+
+    char const* tiles[2] = {"tileA", "tileB"};
+    int current = 0;
+
+    for (size_t k = first; k < stages.size(); )
+    {
+        auto const& stage = stages[k];
+        int radius = stage.radius();
+        int inSide = TileSize + 2 * halo;
+        int outHalo = halo - radius;
+        int outSide = TileSize + 2 * outHalo;
+
+        // Colour matrices up to the next convolution
+        size_t next = k + 1;
+        while (next < stages.size() && stages[next].kind != StencilStage::CONVOLUTION)
+            next++;
+
+        std::ostringstream taps;
+        taps << "            float4 value = (float4)(0.0f);\n"
+                "            for (int dy = 0; dy < " << stage.width << "; dy++)\n"
+                "                for (int dx = 0; dx < " << stage.width << "; dx++)\n"
+                "                    value += stage" << k << "[dy*" << stage.width << " + dx] * "
+             << tiles[current] << "[(by - " << radius << " + dy)*" << inSide << " + bx - " << radius << " + dx];\n";
+        for (size_t c = k + 1; c < next; c++)
+            emit_color_matrix(taps, stages[c], "            ");
+
+        source << "\n";
+        if (next == stages.size())
+        {
+            source << "    {\n"
+                      "        int x = ox + get_local_id(0);\n"
+                      "        int y = oy + get_local_id(1);\n"
+                      "        if (x < width && y < height)\n"
+                      "        {\n"
+                      "            int bx = get_local_id(0) + " << halo << ";\n"
+                      "            int by = get_local_id(1) + " << halo << ";\n"
+                   << taps.str()
+                   << "            imageOut[y*width + x] = value;\n"
+                      "        }\n"
+                      "    }\n";
+        }
+        else
+        {
+            // Positions outside the image take the value at the clamped
+            // position, as if the stage read its own input clamped
+            source << "    for (int i = lid; i < " << outSide * outSide << "; i += " << TileSize * TileSize << ")\n"
+                      "    {\n"
+                      "        int gx = clamp(ox - " << outHalo << " + i % " << outSide << ", 0, width - 1);\n"
+                      "        int gy = clamp(oy - " << outHalo << " + i / " << outSide << ", 0, height - 1);\n"
+                      "        int bx = gx - ox + " << halo << ";\n"
+                      "        int by = gy - oy + " << halo << ";\n"
+                      "        {\n"
+                   << taps.str()
+                   << "            " << tiles[1 - current] << "[i] = value;\n"
+                      "        }\n"
+                      "    }\n"
+                      "    barrier(CLK_LOCAL_MEM_FENCE);\n";
+        }
+
+        halo = outHalo;
+        current = 1 - current;
+        k = next;
+    }
+
+    source << "}\n";
+    return source.str();
+}
+
+StencilChain::StencilChain(cl::Context const& context) :
+    context_ (context),
+    device_ (),
+    queue_ (),
+    localMemory_ (0),
+    programs_ (),
+    kernels_ (),
+    intermediate_ (),
+    intermediatePixels_ (0)
+{
+    auto devices = context_.getInfo<CL_CONTEXT_DEVICES>();
+    if (devices.empty())
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "StencilChain");
+
+    device_ = devices.front();
+    queue_ = cl::CommandQueue(context_, device_);
+    localMemory_ = device_.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    programs_ = ProgramCache::forDevice(context_, device_);
+}
+
+bool StencilChain::fusable(std::vector<StencilStage> const& stages) const
+{
+    return stencil_chain_local_bytes(stages) <= localMemory_;
+}
+
+cl::Kernel& StencilChain::kernel(std::vector<StencilStage> const& stages)
+{
+    auto source = stencil_chain_source(stages);
+    auto found = kernels_.find(source);
+    if (found == kernels_.end())
+        found = kernels_.emplace(source, cl::Kernel(programs_->program(source), "stencil_chain")).first;
+
+    return found->second;
+}
+
+void StencilChain::enqueue(cl::CommandQueue& queue,
+                           cl::Buffer const& devInputImage,
+                           cl::Buffer& devOutputImage,
+                           int width,
+                           int height,
+                           std::vector<StencilStage> const& stages,
+                           cl::Event* event)
+{
+    if (!fusable(stages))
+    {
+        std::vector<cl::Event> events;
+        enqueueUnfused(queue, devInputImage, devOutputImage, width, height, stages, event ? &events : nullptr);
+        if (event && !events.empty())
+            *event = events.back();
+        return;
+    }
+
+    auto& chain = kernel(stages);
+    chain.setArg(0, devInputImage);
+    chain.setArg(1, devOutputImage);
+    chain.setArg(2, width);
+    chain.setArg(3, height);
+
+    queue.enqueueNDRangeKernel(chain, cl::NullRange, cl::NDRange(roundUp(width, TileSize), roundUp(height, TileSize)),
+                               cl::NDRange(TileSize, TileSize), nullptr, event);
+}
+
+void StencilChain::enqueueUnfused(cl::CommandQueue& queue,
+                                  cl::Buffer const& devInputImage,
+                                  cl::Buffer& devOutputImage,
+                                  int width,
+                                  int height,
+                                  std::vector<StencilStage> const& stages,
+                                  std::vector<cl::Event>* events)
+{
+    // Every convolution with the colour matrices around it
+    std::vector<std::vector<StencilStage>> parts(1);
+    bool convolution = false;
+    for (auto const& stage : stages)
+    {
+        if (stage.kind == StencilStage::CONVOLUTION && convolution)
+            parts.emplace_back();
+        convolution |= stage.kind == StencilStage::CONVOLUTION;
+        parts.back().push_back(stage);
+    }
+
+    size_t pixels = size_t(width) * height;
+    if (parts.size() > 1 && pixels > intermediatePixels_)
+    {
+        intermediate_[0] = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * PixelSize);
+        intermediate_[1] = cl::Buffer(context_, CL_MEM_READ_WRITE, pixels * PixelSize);
+        intermediatePixels_ = pixels;
+    }
+
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        auto& part = kernel(parts[i]);
+        part.setArg(0, i == 0 ? devInputImage : intermediate_[(i - 1) & 1]);
+        part.setArg(1, i + 1 == parts.size() ? devOutputImage : intermediate_[i & 1]);
+        part.setArg(2, width);
+        part.setArg(3, height);
+
+        cl::Event event;
+        queue.enqueueNDRangeKernel(part, cl::NullRange, cl::NDRange(roundUp(width, TileSize), roundUp(height, TileSize)),
+                                   cl::NDRange(TileSize, TileSize), nullptr, events ? &event : nullptr);
+        if (events)
+            events->push_back(event);
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef STENCIL_CHAIN_H
+#define STENCIL_CHAIN_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "opencl.h"
+#include "program-cache.h"
+
+// One stage of a filter chain on float4 (RGBA) images
+struct StencilStage
+{
+    enum Kind
+    {
+        // width x width weights, row-major and not flipped like the
+        // `convolution` kernel; every channel is filtered
+        CONVOLUTION,
+        // Per pixel colour matrix, 4 rows of (r, g, b, a, offset)
+        COLOR_MATRIX,
+    };
+
+    Kind kind;
+    int width;
+    std::vector<float> weights;
+
+    int radius() const
+    {
+        return kind == CONVOLUTION ? width / 2 : 0;
+    }
+};
+
+// `width` must be odd
+StencilStage stencil_convolution(int width, std::vector<float> const& weights);
+
+// 20 values, see StencilStage::COLOR_MATRIX
+StencilStage stencil_color_matrix(std::vector<float> const& matrix);
+
+// Runs chains of stencil stages. Every stage reads its input clamped to
+// the image edges.
+//
+// A chain runs as one generated kernel: each 16x16 group loads its output
+// tile plus the summed radii of all stages (the halo) into local memory
+// once, then computes every convolution over a tile that shrinks by its
+// radius, ping-ponging between two local buffers. Colour matrices are
+// applied in registers to the value of the stage before them. Only the
+// input is read from and only the output is written to global memory, so
+// a chain of three stages costs about the bandwidth of one.
+//
+// Chains whose halo tiles do not fit into local memory run stage by stage.
+struct StencilChain
+{
+    StencilChain(cl::Context const& context);
+
+    void enqueue(cl::CommandQueue& queue,
+                 cl::Buffer const& devInputImage,
+                 cl::Buffer& devOutputImage,
+                 int width,
+                 int height,
+                 std::vector<StencilStage> const& stages,
+                 cl::Event* event = nullptr);
+
+    // One kernel and one intermediate image per convolution, for
+    // comparison. The events of all launches are appended to `events`.
+    void enqueueUnfused(cl::CommandQueue& queue,
+                        cl::Buffer const& devInputImage,
+                        cl::Buffer& devOutputImage,
+                        int width,
+                        int height,
+                        std::vector<StencilStage> const& stages,
+                        std::vector<cl::Event>* events = nullptr);
+
+    // Whether enqueue() runs `stages` as a single kernel
+    bool fusable(std::vector<StencilStage> const& stages) const;
+
+    cl::CommandQueue queue() const
+    {
+        return queue_;
+    }
+
+private:
+    // Fused kernel of `stages`, built on first use
+    cl::Kernel& kernel(std::vector<StencilStage> const& stages);
+
+    cl::Context context_;
+    cl::Device device_;
+    cl::CommandQueue queue_;
+    size_t localMemory_;
+    std::shared_ptr<ProgramCache> programs_;     // of device_
+    std::map<std::string, cl::Kernel> kernels_;  // this engine's, by source
+    cl::Buffer intermediate_[2];                 // enqueueUnfused()
+    size_t intermediatePixels_;
+};
+
+// OpenCL C of the fused kernel `stencil_chain` for `stages`
+std::string stencil_chain_source(std::vector<StencilStage> const& stages);
+
+// Local memory the fused kernel of `stages` takes
+size_t stencil_chain_local_bytes(std::vector<StencilStage> const& stages);
+
+#endif // STENCIL_CHAIN_H